@@ -4,6 +4,7 @@
 #include <cstring>
 #include <vector>
 #include <limits>
+#include <poll.h>
 #include "Device.h"
 
 class Cssh : public Device {
@@ -36,6 +37,12 @@ class Cssh : public Device {
         while((c = getchar() != '\n') && c != EOF);
     }
 
+    // true once there is input on stdin, false when wait_ms passed without any
+    inline bool waitInput(int wait_ms){
+        struct pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+        return std::cin.rdbuf()->in_avail() > 0 || poll(&pfd, 1, wait_ms) != 0;
+    }
+
     void updateCacheIp(int port = 10022){
         logi("Enter updateCacheIp port: %d", port);
         displayDeviceCache();
@@ -58,6 +65,474 @@ class Cssh : public Device {
         }
     }
 
+    // exit codes of non-interactive modes, scripts branch on these
+    enum AutoStatus{
+        AUTO_OK = 0,
+        AUTO_USAGE = 2,         // bad options, unknown model or missing config
+        AUTO_NO_DEVICE = 3,     // no device of the model in cache even after a scan / device not in use by ntid
+        AUTO_NONE_FREE = 4,     // devices exist but none is free and reachable
+        AUTO_FAILED = 5         // cache, in-use update or ssh exec failed
+    };
+
+    // pick best free device of requested model without prompting: free first, then lowest rtt, then least
+    // recently used. print_only reserves it and prints its ip on stdout instead of starting the session
+    int autoConnect(bool print_only){
+        logi("Enter autoConnect print_only: %d", print_only);
+        if(!isModelNameFileExist() || !isKnownPmi()){
+            fprintf(stderr, " Unknown device model or friendly_names.config missing\n");
+            return AUTO_USAGE;
+        }
+        if(!isDeviceCacheFileExist() || !loadNewConnectionDeviceInfo()){
+            fprintf(stderr, " Device not in cache, scanning network...\n");
+            if(!scanForModel() && !createDeviceCache()){
+                fprintf(stderr, " No device of requested model found\n");
+                return AUTO_NO_DEVICE;
+            }
+            if(!loadNewConnectionDeviceInfo()){
+                fprintf(stderr, " No device of requested model found\n");
+                return AUTO_NO_DEVICE;
+            }
+        }
+
+        startReachabilityProbe();
+        waitReachabilityProbe(reachabilityProbeTimeoutMs(), true);
+        auto reach = reachabilityByMac();
+        stopReachabilityProbe();
+
+        // reload in-use state under lock, a concurrent allocation may have taken a device meanwhile
+        int lock_fd = lockAllocation();
+        if(lock_fd < 0){
+            fprintf(stderr, " Could not lock device allocation, Exiting...\n");
+            return AUTO_FAILED;
+        }
+        size_t busy_count = 0;
+        if(!loadNewConnectionDeviceInfo() || !selectAutoDevice(reach, busy_count)){
+            unlockAllocation(lock_fd);
+            fprintf(stderr, " No free reachable device of requested model (in use: %ld)\n", busy_count);
+            return AUTO_NONE_FREE;
+        }
+        setDetachedSession(print_only);
+        bool updated = updateUserAccess();
+        unlockAllocation(lock_fd);
+        if(!updated){
+            fprintf(stderr, " Oops some issue in updating user access log, Exiting...\n");
+            return AUTO_FAILED;
+        }
+
+        fprintf(stderr, " Selected device %s\n", requestedDeviceIp().c_str());
+        if(print_only){
+            fprintf(stdout, "%s\n", requestedDeviceIp().c_str());
+            return AUTO_OK;
+        }
+        cancelReachabilityProbe();
+        cleanUp();
+        sshDevice(); // returns only when exec fails
+        return AUTO_FAILED;
+    }
+
+    private:
+    // ssh into ip and run command through shared process runner, batch mode as a password prompt on /dev/tty
+    // would stall every other session running beside it
+    int runRemote(const std::string& ip, const std::string& command, const SpawnOptions& options, std::string& output){
+        std::vector<std::string> args = System::sshArgs(ip.c_str());
+        args.insert(args.end() - 1, {"-o", "BatchMode=yes", "-o", "ServerAliveInterval=5", "-o", "ServerAliveCountMax=3"});
+        if(options.stdin_path.empty())
+            args.insert(args.end() - 1, "-n");
+        args.push_back(command);
+        return ProcessRunner::getInstance().run(args, options, output);
+    }
+
+    // remote command of first device of chain: one fixed relay script (as $0 as well, so it can pass itself on),
+    // part_path and ips of remaining devices as plain arguments. Each device keeps a copy in part_path and
+    // forwards the stream to the next one over its own ssh, so the hub sends every byte once per chain and the
+    // command has same size on every hop. A failed downstream link is drained so the local copy still completes.
+    // Script has no single quote, it is quoted at runtime with q, part_path must not have one either
+    std::string relayCommand(const std::vector<size_t>& chain, const std::string& part_path){
+        std::string script = "q=$(printf \"\\047\"); p=$1; shift; [ $# -eq 0 ] && exec cat > \"$p\"; n=$1; shift; "
+            "tee \"$p\" | { ssh -o UserKnownHostsFile=/dev/null -o StrictHostKeyChecking=no -o BatchMode=yes -o ConnectTimeout=5"
+            " -o ServerAliveInterval=5 -o ServerAliveCountMax=3 -p " + std::to_string(System::m_port) + " root@$n"
+            " \"sh -c $q$0$q $q$0$q $q$p$q $*\" > /dev/null; r=$?; cat > /dev/null; exit $r; }";
+        std::string command = "sh -c " + System::shellQuote(script) + " " + System::shellQuote(script) + " " + System::shellQuote(part_path);
+        for(size_t i = 1; i < chain.size(); i++)
+            command += " " + AddrUtil::ipToString(m_available_devices[chain[i]].ip);
+        return command;
+    }
+
+    public:
+    // copy file to every cached device of requested model at remote_path. Without chain up to workers uploads
+    // run side by side, with chain devices are split in workers relay chains. File lands in remote_path.part,
+    // is checked against local sha256 on every device and only then renamed into place
+    int pushAll(const std::string& file, std::string remote_path, bool chain, size_t workers){
+        logi("Enter pushAll file: %s, remote_path: %s, chain: %d, workers: %ld", file.c_str(), remote_path.c_str(), chain, workers);
+        if(!isModelNameFileExist() || !isKnownPmi()){
+            fprintf(stderr, " Unknown device model or friendly_names.config missing\n");
+            return AUTO_USAGE;
+        }
+        if(access(file.c_str(), R_OK) != 0){
+            fprintf(stderr, " Can not read %s\n", file.c_str());
+            return AUTO_USAGE;
+        }
+        if(!isDeviceCacheFileExist() || !loadNewConnectionDeviceInfo()){
+            fprintf(stderr, " No device of requested model in cache, try cssh -t scan\n");
+            return AUTO_NO_DEVICE;
+        }
+        if(remote_path.empty())
+            remote_path = "/tmp/" + file.substr(file.find_last_of('/') + 1);
+        std::string part_path = remote_path + ".part";
+        if(chain && part_path.find('\'') != std::string::npos){
+            fprintf(stderr, " Remote path of relay chains can not have a single quote\n");
+            return AUTO_USAGE;
+        }
+
+        std::string output;
+        if(ProcessRunner::getInstance().run({"sha256sum", file}, 0, output) != 0 || output.size() < 64){
+            fprintf(stderr, " sha256sum of %s failed\n", file.c_str());
+            return AUTO_FAILED;
+        }
+        std::string checksum = output.substr(0, 64);
+
+        enum Status{ OK = 0, TRANSFER_FAILED, CHECKSUM_MISMATCH };
+        const char* status_names[] = {"OK", "Transfer failed", "Checksum mismatch"};
+        size_t count = m_available_devices.size();
+        std::vector<Status> status(count, OK);
+        std::vector<uint64_t> elapsed_us(count, 0);
+        workers = std::min(workers, count);
+        // transfers get a minute plus 128 KiB/s of file size, a chain a few seconds more per hop to set up
+        struct stat file_stat;
+        int transfer_ms = 60000 + ((stat(file.c_str(), &file_stat) == 0) ? static_cast<int>(std::min<uint64_t>(file_stat.st_size/128, INT32_MAX/2)) : 0);
+
+        fprintf(stderr, " Pushing %s to %s on %ld devices%s...\n", file.c_str(), remote_path.c_str(), count, chain ? " over relay chains" : "");
+        {
+            WorkerPool pool(workers);
+            SpawnOptions options;
+            options.merge_stderr = true;
+            options.stdin_path = file;
+            options.deadline_ms = chain ? transfer_ms + 5000*static_cast<int>((count + workers - 1)/std::max<size_t>(workers, 1)) : transfer_ms;
+            if(chain){
+                // round robin keeps chains of equal length
+                std::vector<std::vector<size_t>> chains(workers);
+                for(size_t i = 0; i < count; i++)
+                    chains[i % workers].push_back(i);
+                for(const std::vector<size_t>& relay : chains){
+                    pool.submit([&, relay]{
+                        std::string transfer_output;
+                        uint64_t start_us = TimeUtil::monotonicUs();
+                        int exit_code = runRemote(AddrUtil::ipToString(m_available_devices[relay.front()].ip), relayCommand(relay, part_path), options, transfer_output);
+                        for(size_t i : relay){
+                            elapsed_us[i] = TimeUtil::monotonicUs() - start_us;
+                            if(exit_code != 0)
+                                status[i] = TRANSFER_FAILED; // a broken link stops the devices behind it, verify tells which got it
+                        }
+                        if(exit_code != 0)
+                            logw("pushAll - relay chain from %s exited with %d: %s", AddrUtil::ipToString(m_available_devices[relay.front()].ip).c_str(), exit_code, transfer_output.c_str());
+                    });
+                }
+            }
+            else{
+                for(size_t i = 0; i < count; i++){
+                    pool.submit([&, i]{
+                        std::string transfer_output;
+                        uint64_t start_us = TimeUtil::monotonicUs();
+                        int exit_code = runRemote(AddrUtil::ipToString(m_available_devices[i].ip), "cat > " + System::shellQuote(part_path), options, transfer_output);
+                        elapsed_us[i] = TimeUtil::monotonicUs() - start_us;
+                        if(exit_code != 0){
+                            status[i] = TRANSFER_FAILED;
+                            logw("pushAll - transfer to %s exited with %d: %s", AddrUtil::ipToString(m_available_devices[i].ip).c_str(), exit_code, transfer_output.c_str());
+                        }
+                    });
+                }
+            }
+            pool.wait();
+
+            // verify every device, also those behind a failed relay link, they may still hold a full copy
+            std::string verify = "sum=$(sha256sum " + System::shellQuote(part_path) + ") && [ \"${sum%% *}\" = " + checksum + " ] && mv -f " + System::shellQuote(part_path) + " " + System::shellQuote(remote_path) + " || { rm -f " + System::shellQuote(part_path) + "; exit 3; }";
+            SpawnOptions verify_options;
+            verify_options.deadline_ms = 60000;
+            for(size_t i = 0; i < count; i++){
+                pool.submit([&, i]{
+                    std::string verify_output;
+                    int exit_code = runRemote(AddrUtil::ipToString(m_available_devices[i].ip), verify, verify_options, verify_output);
+                    if(exit_code == 0)
+                        status[i] = OK;
+                    else if(status[i] == OK)
+                        status[i] = CHECKSUM_MISMATCH;
+                });
+            }
+            pool.wait();
+        }
+
+        char hyphens[71];
+        memset(hyphens, '-', 70);
+        hyphens[70] = '\0';
+        size_t failed = 0;
+        fprintf(stderr, "\n %s\n", hyphens);
+        fprintf(stderr, " %-4s %-16s %-18s %-18s %-10s\n", "SNo", "IP", "MAC", "Status", "Time(s)");
+        fprintf(stderr, " %s\n", hyphens);
+        for(size_t i = 0; i < count; i++){
+            if(status[i] != OK)
+                failed++;
+            fprintf(stderr, " %-4ld %-16s %-18s %-18s %-10.2f\n", i+1, AddrUtil::ipToString(m_available_devices[i].ip).c_str(), AddrUtil::macToString(m_available_devices[i].mac).c_str(), status_names[status[i]], elapsed_us[i]/1e6);
+        }
+        fprintf(stderr, " %s\n", hyphens);
+        fprintf(stderr, " Succeeded: %ld, Failed: %ld\n\n", count - failed, failed);
+        return (failed == 0) ? AUTO_OK : AUTO_FAILED;
+    }
+
+    // stream remote paths (remote shell globs apply) and/or command output from every cached device of requested
+    // model into one local tar, members of a device under "<ip>/", command output as "<ip>/command.out".
+    // Each device's "tar -cf -" is re-packed into the archive as it arrives, a member meeting the archive busy with
+    // another device is spooled until complete. A device gets deadline_ms (default 30 min), its ssh is then killed
+    // and what it sent so far stays in the archive as truncated
+    int collectAll(const std::string& paths, const std::string& command, std::string archive_path, size_t workers, int deadline_ms = 30*60*1000){
+        logi("Enter collectAll paths: %s, command: %s, archive: %s, workers: %ld", paths.c_str(), command.c_str(), archive_path.c_str(), workers);
+        if(!isModelNameFileExist() || !isKnownPmi()){
+            fprintf(stderr, " Unknown device model or friendly_names.config missing\n");
+            return AUTO_USAGE;
+        }
+        if(!isDeviceCacheFileExist() || !loadNewConnectionDeviceInfo()){
+            fprintf(stderr, " No device of requested model in cache, try cssh -t scan\n");
+            return AUTO_NO_DEVICE;
+        }
+        if(archive_path.empty()){
+            char name[64];
+            time_t now = time(nullptr);
+            strftime(name, sizeof(name), "cssh_collect_%Y%m%d_%H%M%S.tar", gmtime(&now));
+            archive_path = name;
+        }
+        TarArchive archive;
+        if(!archive.open(archive_path)){
+            fprintf(stderr, " Can not create %s\n", archive_path.c_str());
+            return AUTO_USAGE;
+        }
+
+        // command output goes through a temp dir on device so tar knows its size up front, -C comes after the
+        // user paths so relative ones still resolve against login directory
+        std::string remote = "tar -cf - " + paths;
+        if(!command.empty())
+            remote = "d=$(mktemp -d) && { (" + command + ") > \"$d/command.out\" 2>&1; tar -cf - " + paths + " -C \"$d\" command.out; rc=$?; rm -rf \"$d\"; exit $rc; }";
+
+        struct HostRun {
+            int exit_code;
+            bool complete;
+            size_t members;
+            uint64_t bytes;
+        };
+        size_t count = m_available_devices.size();
+        std::vector<HostRun> runs(count, HostRun{-1, false, 0, 0});
+
+        fprintf(stderr, " Collecting from %ld devices into %s...\n", count, archive_path.c_str());
+        {
+            WorkerPool pool(std::min(workers, count));
+            for(size_t i = 0; i < count; i++){
+                pool.submit([&, i]{
+                    HostRun& run = runs[i];
+                    std::string ip = AddrUtil::ipToString(m_available_devices[i].ip);
+                    int fds[2];
+                    if(pipe2(fds, O_CLOEXEC) != 0){
+                        loge("collectAll - pipe failed errno: %d", errno);
+                        return;
+                    }
+
+                    std::mutex exit_mutex;
+                    std::condition_variable exit_cv;
+                    bool exited = false;
+                    SpawnOptions options;
+                    options.stdout_fd = fds[1];
+                    options.deadline_ms = deadline_ms;
+                    std::vector<std::string> args = System::sshArgs(ip.c_str());
+                    args.insert(args.end() - 1, {"-n", "-o", "BatchMode=yes", "-o", "ServerAliveInterval=5", "-o", "ServerAliveCountMax=3"});
+                    args.push_back(remote);
+                    bool spawned = ProcessRunner::getInstance().spawn(args, options, [&](const ProcessResult& result){
+                        std::lock_guard<std::mutex> lock(exit_mutex);
+                        run.exit_code = result.exit_code;
+                        exited = true;
+                        exit_cv.notify_one();
+                    });
+                    ::close(fds[1]);
+
+                    // blocking reads end at EOF, which also comes when the runner kills ssh at its deadline
+                    TarStream stream(archive, ip);
+                    char buffer[16384];
+                    ssize_t len;
+                    while((len = read(fds[0], buffer, sizeof(buffer))) != 0){
+                        if(len < 0){
+                            if(errno == EINTR)
+                                continue;
+                            break;
+                        }
+                        stream.feed(buffer, len);
+                    }
+                    ::close(fds[0]);
+                    run.complete = stream.finish();
+                    run.members = stream.members();
+                    run.bytes = stream.bytes();
+
+                    if(spawned){
+                        std::unique_lock<std::mutex> lock(exit_mutex);
+                        exit_cv.wait(lock, [&]{ return exited; });
+                    }
+                });
+            }
+            pool.wait();
+        }
+        if(!archive.close())
+            fprintf(stderr, " Writing %s failed\n", archive_path.c_str());
+
+        char hyphens[71];
+        memset(hyphens, '-', 70);
+        hyphens[70] = '\0';
+        size_t failed = 0;
+        fprintf(stderr, "\n %s\n", hyphens);
+        fprintf(stderr, " %-4s %-16s %-18s %-6s %-8s %-12s\n", "SNo", "IP", "MAC", "Exit", "Members", "Size(KB)");
+        fprintf(stderr, " %s\n", hyphens);
+        for(size_t i = 0; i < count; i++){
+            // tar exits 1 when files changed while read (busybox also for missing paths), what it sent is complete
+            // in the archive so that device still counts as succeeded, only marked partial. Gnu tar's 2 is a failure
+            bool partial = (runs[i].exit_code == 1 && runs[i].complete && runs[i].members > 0);
+            if((runs[i].exit_code != 0 && !partial) || !runs[i].complete)
+                failed++;
+            fprintf(stderr, " %-4ld %-16s %-18s %-6d %-8ld %-12.1f%s\n", i+1, AddrUtil::ipToString(m_available_devices[i].ip).c_str(), AddrUtil::macToString(m_available_devices[i].mac).c_str(), runs[i].exit_code, runs[i].members, runs[i].bytes/1024.0, runs[i].complete ? (partial ? " (partial)" : "") : " (truncated)");
+        }
+        fprintf(stderr, " %s\n", hyphens);
+        fprintf(stderr, " Succeeded: %ld, Failed: %ld, Archive: %s\n\n", count - failed, failed, archive_path.c_str());
+        return (failed == 0) ? AUTO_OK : AUTO_FAILED;
+    }
+
+    // run command on every cached device of requested model, at most workers ssh sessions at a time.
+    // Output is streamed line by line with an "[ip]" prefix, or with collect printed per device once all are
+    // done. Ends with an exit code summary, AUTO_FAILED when any device did not return 0
+    int execAll(const std::string& command, bool collect, size_t workers){
+        logi("Enter execAll command: %s, collect: %d, workers: %ld", command.c_str(), collect, workers);
+        if(!isModelNameFileExist() || !isKnownPmi()){
+            fprintf(stderr, " Unknown device model or friendly_names.config missing\n");
+            return AUTO_USAGE;
+        }
+        if(!isDeviceCacheFileExist() || !loadNewConnectionDeviceInfo()){
+            fprintf(stderr, " No device of requested model in cache, try cssh -t scan\n");
+            return AUTO_NO_DEVICE;
+        }
+
+        struct HostRun {
+            int exit_code;
+            uint64_t elapsed_us;
+            std::string output;
+            std::string partial; // streamed output after last newline
+        };
+        std::vector<HostRun> runs(m_available_devices.size());
+        // streamed lines are queued by the process runner thread and written here, a slow stdout consumer must not
+        // stall the runner loop of every session. Lines beyond the queue bound are dropped and counted
+        const size_t MAX_QUEUED_BYTES = 16 << 20;
+        std::deque<std::string> lines;
+        size_t queued_bytes = 0;
+        size_t dropped_lines = 0;
+        size_t finished = 0;
+        std::mutex out_mutex;
+        std::condition_variable out_cv;
+        auto queueLine = [&](const std::string& ip, const std::string& line){
+            if(queued_bytes > MAX_QUEUED_BYTES){
+                dropped_lines++;
+                return;
+            }
+            lines.push_back("[" + ip + std::string(ip.size() < 15 ? 15 - ip.size() : 0, ' ') + "] " + line + "\n");
+            queued_bytes += lines.back().size();
+            out_cv.notify_one();
+        };
+
+        fprintf(stderr, " Running on %ld devices...\n", m_available_devices.size());
+        {
+            WorkerPool pool(std::min(workers, m_available_devices.size()));
+            for(size_t i = 0; i < m_available_devices.size(); i++){
+                pool.submit([&, i]{
+                    HostRun& run = runs[i];
+                    std::string ip = AddrUtil::ipToString(m_available_devices[i].ip);
+                    SpawnOptions options;
+                    options.merge_stderr = true;
+                    options.max_output = collect ? (1 << 20) : 0;
+                    if(!collect){
+                        options.onOutput = [&](const char* data, size_t len){
+                            std::lock_guard<std::mutex> lock(out_mutex);
+                            run.partial.append(data, len);
+                            size_t eol;
+                            while((eol = run.partial.find('\n')) != std::string::npos){
+                                queueLine(ip, run.partial.substr(0, eol));
+                                run.partial.erase(0, eol + 1);
+                            }
+                        };
+                    }
+
+                    uint64_t start_us = TimeUtil::monotonicUs();
+                    run.exit_code = runRemote(ip, command, options, run.output);
+                    run.elapsed_us = TimeUtil::monotonicUs() - start_us;
+                    std::lock_guard<std::mutex> lock(out_mutex);
+                    if(!run.partial.empty())
+                        queueLine(ip, run.partial);
+                    finished++;
+                    out_cv.notify_one();
+                });
+            }
+
+            std::unique_lock<std::mutex> lock(out_mutex);
+            while(finished < runs.size() || !lines.empty()){
+                out_cv.wait(lock, [&]{ return finished == runs.size() || !lines.empty(); });
+                std::deque<std::string> batch;
+                batch.swap(lines);
+                queued_bytes = 0;
+                lock.unlock();
+                for(const std::string& line : batch)
+                    fputs(line.c_str(), stdout);
+                fflush(stdout);
+                lock.lock();
+            }
+            lock.unlock();
+            if(dropped_lines > 0)
+                fprintf(stderr, " %ld output lines dropped, stdout did not keep up\n", dropped_lines);
+            pool.wait();
+        }
+
+        if(collect){
+            for(size_t i = 0; i < runs.size(); i++){
+                fprintf(stdout, "==== %s (%s) exit %d ====\n", AddrUtil::ipToString(m_available_devices[i].ip).c_str(), AddrUtil::macToString(m_available_devices[i].mac).c_str(), runs[i].exit_code);
+                fputs(runs[i].output.c_str(), stdout);
+                if(!runs[i].output.empty() && runs[i].output.back() != '\n')
+                    fputc('\n', stdout);
+            }
+            fflush(stdout);
+        }
+
+        char hyphens[61];
+        memset(hyphens, '-', 60);
+        hyphens[60] = '\0';
+        size_t failed = 0;
+        fprintf(stderr, "\n %s\n", hyphens);
+        fprintf(stderr, " %-4s %-16s %-18s %-6s %-10s\n", "SNo", "IP", "MAC", "Exit", "Time(s)");
+        fprintf(stderr, " %s\n", hyphens);
+        for(size_t i = 0; i < runs.size(); i++){
+            if(runs[i].exit_code != 0)
+                failed++;
+            fprintf(stderr, " %-4ld %-16s %-18s %-6d %-10.2f\n", i+1, AddrUtil::ipToString(m_available_devices[i].ip).c_str(), AddrUtil::macToString(m_available_devices[i].mac).c_str(), runs[i].exit_code, runs[i].elapsed_us/1e6);
+        }
+        fprintf(stderr, " %s\n", hyphens);
+        fprintf(stderr, " Succeeded: %ld, Failed: %ld\n\n", runs.size() - failed, failed);
+        return (failed == 0) ? AUTO_OK : AUTO_FAILED;
+    }
+
+    // release ntid's device with given ip without prompting
+    int close(const std::string& ip){
+        logi("Enter close ip: %s", ip.c_str());
+        size_t dev_index;
+        if(!loadUserDeviceInfo() || !findUserDevice(ip, dev_index)){
+            fprintf(stderr, " Device %s is not in use by this user\n", ip.c_str());
+            return AUTO_NO_DEVICE;
+        }
+        setCloseConnectionUserRequest(dev_index);
+        if(!updateUserAccess()){
+            fprintf(stderr, " Oops some issue in updating user access log, Exiting...\n");
+            return AUTO_FAILED;
+        }
+        fprintf(stderr, " User logout successfull\n");
+        return AUTO_OK;
+    }
+
     void display_user_device(void){
         logi("Enter display_user_device");
         if(!loadUserDeviceInfo()){
@@ -126,6 +601,7 @@ class Cssh : public Device {
                 
                 case DEVICE_INFO:
                     logi("Enter state DEVICE_INFO");
+                    stopReachabilityProbe(); // candidates are reloaded
                     // find user requested device info in the device info cache
                     if(!loadNewConnectionDeviceInfo()){
                         fprintf(stderr, " Opps some issue in finding device, would you like to update cache and try again(y/n)? ");
@@ -139,7 +615,12 @@ class Cssh : public Device {
 
                 case CACHE_CREATE:
                     logi("Enter state CACHE_CREATE");
-                    fprintf(stderr, " Scanning network and parsing date will take less than 2 minutes, please wait...\n");
+                    fprintf(stderr, " Scanning network and fetching device info will take a few seconds, please wait...\n");
+                    // look for requested model first, whole network only if none of it is found
+                    if(isKnownPmi() && scanForModel()){
+                        state = DEVICE_INFO;
+                        break;
+                    }
                     if(!createDeviceCache()){
                         fprintf(stderr, " Some issue with creating device cache, exiting...\n");
                         state = END;
@@ -150,8 +631,22 @@ class Cssh : public Device {
 
                 case USER_REQUEST:
                     logi("Enter state USER_REQUEST");
+                    // probe all candidates while user decides, list is shown once quick ones have answered
+                    if(!isReachabilityProbeRunning())
+                        startReachabilityProbe();
+                    waitReachabilityProbe(300);
                     displayConnectionInfo();
                     fprintf(stderr, " Enter device index (0 to quit): "); // q qill result in infinite loop
+                    // list is drawn again once remaining ssh checks settle, unless user already answered
+                    if(!isReachabilitySettled()){
+                        while(!waitInput(250)){
+                            if(isReachabilitySettled()){
+                                displayConnectionInfo();
+                                fprintf(stderr, " Enter device index (0 to quit): ");
+                                break;
+                            }
+                        }
+                    }
                     size_t dev_index;
                     std::cin >> dev_index;
                     if(dev_index > 0 && dev_index <= m_available_devices.size() && dev_index != 0){
@@ -181,6 +676,13 @@ class Cssh : public Device {
                 case CONNECT:
                     logi("Enter state CONNECT");
                     if(isDeviceReachable()){
+                        cancelReachabilityProbe();
+                        updateUserAccess();
+                        cleanUp();
+                        sshDevice();
+                    }
+                    else if(reResolveDeviceIp()){
+                        cancelReachabilityProbe();
                         updateUserAccess();
                         cleanUp();
                         sshDevice();
@@ -11,14 +11,22 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/file.h>
+#include <unordered_map>
 #include <algorithm>
 #include <iostream>
 #include <algorithm>
+#include <mutex>
+#include <memory>
+#include <condition_variable>
 #include "Logger.h"
 #include "System.h"
 #include "Utils.h"
 #include "Network.h"
 #include <pwd.h>
+#include <fcntl.h>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 // NOTE: Given user can access any number of devices, but can only extablish one session with one device type
 
@@ -32,51 +40,266 @@ enum FError : uint32_t {
     INVALID_ARG             = EINVAL,       // Invalid argument
     NO_SPACE                = ENOSPC,       // No space left on device
     READ_ONLY               = EROFS,        // Read-only file system
-    INTERRUPTED             = EINTR         // Interrupted system call
+    INTERRUPTED             = EINTR,        // Interrupted system call
+    BAD_FORMAT              = EBADMSG,      // Table header magic, schema version or record size mismatch
+    STALE                   = ESTALE        // Table was republished since it was mapped
 };
 
+// every .dat table starts with this header followed by count records of recordSize bytes. A published table is
+// never modified, writers publish a new generation with rename, so readers map it without lock or copy. Only
+// exception is the in-use table: its slots are stored in place under exclusive lock (storeInUseSlot), so it is
+// read as a copy under shared lock instead (deserialize with copy)
+struct TableHeader {
+    const static uint32_t MAGIC = 0x48535343;  // "CSSH", reads byte swapped on a host of other byte order
+    uint32_t magic;
+    uint32_t version;       // SCHEMA_VERSION of record type
+    uint32_t recordSize;    // sizeof record type
+    uint32_t indexes;       // hash index sections after records, 0 or TableIndex<T>::COUNT
+    uint64_t count;
+    uint64_t generation;    // bumped on every publish
+};
 
-struct DeviceInfo {
-    char pmi[16];
-    char ip[16];
-    char mac[18];
+// one hash index section per key follows the records: open addressing slots sized to twice the records, each
+// holding first record of a key hash, then per record the next record of same key hash (chains non unique keys
+// like pmi, in table order)
+struct IndexSlot {
+    uint32_t hash;
+    uint32_t record;        // record index + 1, 0 is an empty slot
+};
+
+// fnv-1a, keys of table indexes are hashed with it
+inline uint32_t keyHash(const void* key, size_t len){
+    uint32_t hash = 2166136261u;
+    for(size_t i = 0; i < len; i++)
+        hash = (hash ^ static_cast<const uint8_t*>(key)[i]) * 16777619u;
+    return hash;
+}
+
+inline uint32_t keyHash(const char* key){
+    return keyHash(key, strlen(key));
+}
+
+inline size_t indexSlots(size_t count){
+    size_t slots = 1;
+    while(slots < 2*count)
+        slots <<= 1;
+    return slots;
+}
+
+// bytes of one index section of a table of count records
+inline size_t indexSize(size_t count){
+    return indexSlots(count)*sizeof(IndexSlot) + count*sizeof(uint32_t);
+}
+
+// 6 byte mac as integer key of hash maps
+inline uint64_t macKey(const uint8_t* mac){
+    uint64_t key = 0;
+    memcpy(&key, mac, 6);
+    return key;
+}
+
+
+// records keep ipv4 as uint32 in network byte order, mac as 6 bytes (all zero while unknown), times as epoch
+// seconds and pmi as id of names dictionary, fields ordered widest first so nothing is padded.
+// AddrUtil/TimeUtil/nameOf format them for display only
+struct DeviceInfo {                 // 24 bytes
+    const static uint32_t SCHEMA_VERSION = 3;
+    int64_t lastVerified;           // epoch seconds when device last answered a scan with this ip
+    uint32_t ip;
+    uint32_t pmiId;
+    uint8_t mac[6];
+};
+
+// in-use table is slotted, a free slot is all zero (startTime 0) and is taken by next session. Its index section is
+// an InUseDirectory that finds slot of a mac and a free slot without reading the table
+struct DeviceInUseInfo {            // 40 bytes
+    const static uint32_t SCHEMA_VERSION = 5;
+    int64_t startTime;
+    uint32_t ip;
+    int32_t processId;
+    uint32_t pmiId;
+    uint8_t mac[6];
+    char ntid[10];
 };
 
-struct DeviceInUseInfo {
+// in-use records of earlier builds, read only to carry their sessions over into slots (migrateInUseTable).
+// Schema 1 is also found headerless. Schemas 3 and 4 have the layout of 5, 3 packed with a mac index, 4 slotted
+// without directory
+struct DeviceInUseInfoV1 {          // 84 bytes
+    const static uint32_t SCHEMA_VERSION = 1;
     char pmi[16];
     char ip[16];
     char mac[18];
     char ntid[10];
     char startTime[20];
-    pid_t processId;
+    int32_t processId;
+};
+
+struct DeviceInUseInfoV2 {          // 48 bytes
+    const static uint32_t SCHEMA_VERSION = 2;
+    int64_t startTime;
+    char pmi[16];
+    uint32_t ip;
+    int32_t processId;
+    uint8_t mac[6];
+    char ntid[10];
+};
+
+// names dictionary, each pmi and friendly name is stored once and records refer to it by id. Id of a name is its
+// index + 1 (0 is no name), names are only appended so an id never changes. Friendly names point to their pmi
+struct NameInfo {                   // 40 bytes
+    const static uint32_t SCHEMA_VERSION = 1;
+    enum Kind : uint32_t { PMI = 0, FRIENDLY, CONFIG };  // CONFIG: one record, stamp of config names were synced with
+    uint32_t kind;
+    uint32_t pmiId;                 // FRIENDLY: id of its pmi, 0 once dropped from friendly_names.config
+    char name[32];
+};
+
+// keys a table is indexed on when published, tables of other records have none
+template<typename T>
+struct TableIndex {
+    enum Key : uint32_t { COUNT = 0 };
+    static uint32_t hash(const T&, uint32_t){ return 0; }
+};
+
+template<>
+struct TableIndex<DeviceInfo> {
+    enum Key : uint32_t { PMI = 0, MAC, COUNT };
+    static uint32_t hash(const DeviceInfo& record, uint32_t key){ return (key == PMI) ? keyHash(&record.pmiId, sizeof(record.pmiId)) : keyHash(record.mac, sizeof(record.mac)); }
+};
+
+template<>
+struct TableIndex<NameInfo> {
+    enum Key : uint32_t { NAME = 0, COUNT };
+    static uint32_t hash(const NameInfo& record, uint32_t){ return keyHash(record.name); }
 };
 
+// one section, an InUseDirectory instead of a hash index, findRecord scans
+template<>
+struct TableIndex<DeviceInUseInfo> {
+    enum Key : uint32_t { MAC = 0, COUNT };
+    static uint32_t hash(const DeviceInUseInfo& record, uint32_t){ return keyHash(record.mac, sizeof(record.mac)); }
+};
+
+// index section of in-use table, patched in place by storeInUseSlot along with the slot: head of the free slot list,
+// then mac hash -> slot (open addressing like IndexSlot, a released mac leaves a tombstone so probes of other macs
+// go on past it) and per slot the next free slot. Tombstones are dropped when table is republished
+struct InUseDirectory {
+    const static uint32_t TOMBSTONE = 0xffffffff;
+    uint32_t freeHead;      // first free slot + 1, 0 when all are taken
+    uint32_t tombstones;
+    // IndexSlot macs[indexSlots(count)] and uint32_t nextFree[count] (slot + 1) follow
+};
+
+inline size_t inUseDirectorySize(size_t count){
+    return sizeof(InUseDirectory) + indexSize(count);
+}
+
+// bytes of all index sections of a table of count records
+template<typename T>
+inline size_t indexesSize(uint32_t indexes, size_t count){
+    return indexes*indexSize(count);
+}
+
+template<>
+inline size_t indexesSize<DeviceInUseInfo>(uint32_t indexes, size_t count){
+    return indexes*inUseDirectorySize(count);
+}
+
 struct ConnectionInfo{
-    char ip[16];
-    char mac[18];
+    int64_t startTime;              // 0 while device is free
+    uint32_t ip;
+    int32_t processId;
+    uint8_t mac[6];
     char ntid[10];
-    char startTime[20];
     uint8_t isBeingUsed;
-    pid_t processId;
 };
 
 struct UserDeviceInfo{
-    char pmi[16];
-    char ip[16];
-    char mac[18];
-    char startTime[20];
+    int64_t startTime;
+    uint32_t ip;
+    uint32_t pmiId;
+    uint8_t mac[6];
 };
 
 struct LoginRecordInfo{
+    int64_t startTime;
+    int64_t endTime;
+    uint32_t ip;
+    uint32_t pmiId;
+    uint8_t mac[6];
     char ntid[10];
-    char pmi[16];
-    char ip[16];
-    char mac[18];
-    char startTime[20];
-    char endTime[20];
     char logoutType[7];
 };
 
+// hosts that refused or timed out on ssh port, keyed by mac. Scans skip them till retryAfter, backoff doubles
+// with every consecutive failure. Safe to use from pmi worker threads
+struct NegativeCacheInfo {
+    const static uint32_t SCHEMA_VERSION = 1;
+    char mac[18];
+    char ip[16];
+    uint32_t failures;  // consecutive failed ssh probes
+    time_t lastFailure;
+    time_t retryAfter;  // epoch seconds, host is skipped by scans before this
+};
+
+class NegativeCache {
+    private:
+    std::map<std::string, NegativeCacheInfo> m_entries;
+    std::mutex m_mutex;
+    time_t m_base_ttl_s;
+    time_t m_max_ttl_s;
+
+    public:
+    NegativeCache(time_t base_ttl_s = 10*60, time_t max_ttl_s = 24*60*60)
+        : m_base_ttl_s(base_ttl_s), m_max_ttl_s(max_ttl_s)
+    { }
+
+    void load(const NegativeCacheInfo* entries, size_t size){
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for(size_t i = 0; i < size; i++)
+            m_entries[(entries+i)->mac] = *(entries+i);
+    }
+
+    std::vector<NegativeCacheInfo> entries(void){
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::vector<NegativeCacheInfo> result;
+        for(const auto& entry : m_entries)
+            result.push_back(entry.second);
+        return result;
+    }
+
+    bool empty(void){
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_entries.empty();
+    }
+
+    bool isBlocked(const char* mac, time_t now){
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_entries.find(mac);
+        return it != m_entries.end() && now < it->second.retryAfter;
+    }
+
+    void recordFailure(const char* mac, const char* ip, time_t now){
+        std::lock_guard<std::mutex> lock(m_mutex);
+        NegativeCacheInfo& entry = m_entries[mac];
+        if(entry.failures == 0){
+            strcpy(entry.mac, mac);
+        }
+        strcpy(entry.ip, ip);
+        entry.failures++;
+        entry.lastFailure = now;
+        time_t ttl = m_base_ttl_s << std::min<uint32_t>(entry.failures - 1, 16);
+        entry.retryAfter = now + std::min(ttl, m_max_ttl_s);
+        logd("NegativeCache - %s at %s failed %d times, skipped till %s", mac, ip, entry.failures, TimeUtil::toUTC(entry.retryAfter).c_str());
+    }
+
+    void recordSuccess(const char* mac){
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_entries.erase(mac);
+    }
+};
+
 class Device {
     char* homeDir = std::getenv("homeDir");
     std::string prefixPath = (homeDir) ? std::string(std::string(homeDir) + "/cssh/") : "./";
@@ -85,14 +308,21 @@ class Device {
     char* m_login_record_filename = strdup(std::string(prefixPath  + "device_login_record.csv").c_str());
     char* m_login_record_sno_filename = strdup(std::string(prefixPath + "device_login_record_sno.txt").c_str());
     char* m_model_names_filename = strdup(std::string(prefixPath + "friendly_names.config").c_str());
+    char* m_rtt_history_filename = strdup(std::string(prefixPath + "device_rtt_history.dat").c_str());
+    char* m_negative_cache_filename = strdup(std::string(prefixPath + "device_negative.dat").c_str());
+    char* m_alloc_lock_filename = strdup(std::string(prefixPath + "device_alloc.lock").c_str());
+    char* m_names_filename = strdup(std::string(prefixPath + "device_names.dat").c_str());
+    char* m_names_lock_filename = strdup(std::string(prefixPath + "device_names.lock").c_str());
 
     private:
     std::string m_friendly_name;
     std::string m_pmi;
+    uint32_t m_pmi_id = 0;      // names dictionary id of m_pmi, 0 when friendly name is not configured
     std::string m_ntid;
     
-    DeviceInfo* m_device_cache_ptr = nullptr;
+    DeviceInfo* m_device_cache_ptr = nullptr;   // mapping of device cache table, patched entries are republished
     size_t m_device_cache_size = 0;
+    uint64_t m_device_cache_generation = 0;
 
     DeviceInUseInfo* m_device_in_use_ptr = nullptr;
     size_t m_device_in_use_size = 0;
@@ -105,8 +335,47 @@ class Device {
     } m_request_type = RequestType::UNKNOWN;
 
     size_t m_user_requested_index = -1;
+    bool m_detached_session = false; // session is not run by this process (eg. -a ip), no pid to kill on forced logout
+
+    std::map<std::string, std::string> m_model_name_pmi_map;   // filled only when friendly_names.config is re-read
+
+    NameInfo* m_names_ptr = nullptr;    // mapping of names dictionary, remapped whenever a name is appended
+    size_t m_names_size = 0;
+    std::mutex m_names_mutex;           // pmi workers intern concurrently
+
+    std::string m_scan_range = "10.0.0.0/24"; // comma separated cidr/ip ranges swept by createDeviceCache
 
-    std::map<std::string, std::string> m_model_name_pmi_map;
+    public:
+    enum ScanMode{
+        ICMP = 0,   // echo sweep, then read kernel neighbor table
+        ARP         // arp sweep on raw packet socket, finds hosts that drop icmp
+    };
+
+    private:
+    ScanMode m_scan_mode = ScanMode::ICMP;
+    size_t m_pmi_workers = 8;   // concurrent ssh probes while fetching pmi
+    bool m_incremental_scan = true;         // reuse pmi of cached devices whose mac->ip mapping did not change
+    time_t m_cache_keep_s = 12*60*60;       // silent devices verified within this window stay in cache
+    size_t m_model_matches = 3;             // targeted scan stops after these many devices of requested model
+    int m_pmi_deadline_s = 5;               // upper bound of one pmi probe
+    int m_port_probe_timeout_ms = 1500;     // tcp connect + ssh banner, closed/filtered hosts fail here before any ssh
+
+    // speculative reachability of m_available_devices, probed while user is still choosing
+    struct Reachability {
+        enum State{
+            PENDING = 0,  // tcp probe of ssh port in flight
+            SSH_CHECK,    // sshd answered, pmi read over ssh in flight
+            REACHABLE,    // pmi matched, ssh master is kept for the session
+            UNREACHABLE
+        } state;
+        uint32_t rtt_us;  // tcp handshake time
+    };
+    std::vector<Reachability> m_reachability;
+    std::mutex m_reachability_mutex;
+    std::condition_variable m_reachability_cv;
+    bool m_reachability_cancelled = false;
+    std::unique_ptr<WorkerPool> m_reachability_pool;
+    std::unique_ptr<PortProbe> m_reachability_probe;
 
     protected:
     std::vector<ConnectionInfo> m_available_devices;
@@ -135,77 +404,327 @@ class Device {
         });
     }
 
+    // publish records as next generation of table: written to a temp file beside it, synced and renamed over it.
+    // Publishers are serialized by an exclusive lock on current file. expected_generation != 0 publishes only over
+    // that generation (read-modify-write of a mapped table), a table republished meanwhile wins
     template <typename T>
-    uint32_t serialize(const char* file_name, T* outptr, size_t size){
+    uint32_t serialize(const char* file_name, const T* outptr, size_t size, uint64_t expected_generation = 0){
         logi("Enter serialize file_name: %s, size: %d", file_name, size);
         errno = 0;
-        FILE* fileptr = std::fopen(file_name, "wb");
-        if(fileptr == 0){
-            loge("serialize - Failed to open file: %s errno: %d errorstr: %s", file_name, errno, std::strerror(errno));
-            return errno;
-        }
-        
-        if(size == 0 || outptr == nullptr)
+        TableHeader header = {TableHeader::MAGIC, T::SCHEMA_VERSION, sizeof(T), TableIndex<T>::COUNT, size, 1};
+        if(size != 0 && outptr == nullptr){
             loge("serialize - Invalid size(%d) or outptr", size);
+            return FError::INVALID_ARG;
+        }
 
-        int fd = fileno(fileptr);
-        if (flock(fd, LOCK_EX) == -1) // lock is automatically released after fclose
-            loge("serialize - Exclusive file lock failed errno: %d", errno);
+        int lock_fd = -1;
+        struct stat locked_stat, file_stat;
+        while((lock_fd = open(file_name, O_RDONLY | O_CLOEXEC)) >= 0){
+            if(flock(lock_fd, LOCK_EX) == -1) // lock is released on close
+                loge("serialize - Exclusive file lock failed errno: %d", errno);
+            // publisher that held the lock may have renamed a new generation over it meanwhile
+            if(fstat(lock_fd, &locked_stat) == 0 && stat(file_name, &file_stat) == 0 && locked_stat.st_ino == file_stat.st_ino)
+                break;
+            close(lock_fd);
+        }
 
-        if(std::fwrite(&size, sizeof(size), 1, fileptr) != 1) {
-            loge("serialize - fwrite failed - errno: %d", errno);
-            std::fclose(fileptr);
-            return errno;
+        TableHeader current = {};
+        if(lock_fd >= 0 && pread(lock_fd, &current, sizeof(current), 0) == sizeof(current) && current.magic == TableHeader::MAGIC)
+            header.generation = current.generation + 1;
+        if(expected_generation != 0 && current.generation != expected_generation){
+            logw("serialize - %s was republished (generation %ld), dropping update of generation %ld", file_name, current.generation, expected_generation);
+            if(lock_fd >= 0)
+                close(lock_fd);
+            return FError::STALE;
         }
 
-        if(size != 0 ){
-            if(std::fwrite(outptr, sizeof(T), size, fileptr) != size){
-                loge("serialize - fwrite failed - errno: %d", errno);
-                std::fclose(fileptr);
-                return errno;
-            }
+        std::string temp_name = std::string(file_name) + ".XXXXXX";
+        int fd = mkstemp(&temp_name[0]);
+        if(fd < 0){
+            uint32_t result = errno;
+            loge("serialize - Failed to create temp file for: %s errno: %d errorstr: %s", file_name, errno, std::strerror(errno));
+            if(lock_fd >= 0)
+                close(lock_fd);
+            return result;
         }
+        fchmod(fd, 0644);
+
+        FILE* fileptr = fdopen(fd, "wb");
+        bool written = fileptr && std::fwrite(&header, sizeof(header), 1, fileptr) == 1
+            && (size == 0 || std::fwrite(outptr, sizeof(T), size, fileptr) == size);
+        // indexes go into same file, a published table never has indexes of another generation
+        written = written && writeIndexes(fileptr, outptr, size);
+        written = written && std::fflush(fileptr) == 0 && fsync(fd) == 0;
+        uint32_t result = written ? (uint32_t)FError::NO_ERROR : (errno ? errno : (uint32_t)FError::IO_ERROR);
+        if(!written)
+            loge("serialize - write of %s failed - errno: %d", temp_name.c_str(), errno);
+        if(fileptr)
+            std::fclose(fileptr);
+        else
+            close(fd);
 
-        std::fclose(fileptr);
-        return errno;
+        if(written && rename(temp_name.c_str(), file_name) != 0){
+            result = errno;
+            loge("serialize - rename to %s failed - errno: %d", file_name, errno);
+            written = false;
+        }
+        if(!written)
+            unlink(temp_name.c_str());
+        if(lock_fd >= 0)
+            close(lock_fd);
+        return result;
     }
 
+    // map table for this process: pages come from page cache and a page is copied only when a record in it is
+    // patched before republishing (MAP_PRIVATE). No lock is held, a published table never changes. Headerless tables
+    // of earlier versions (raw size_t count) are mapped as well and get a header on their next publish.
+    // copy reads the table into anonymous memory under shared lock instead, for the in-use table whose slots are
+    // stored in place. A caller already holding the lock of file passes its locked_fd. Both are released by unmap
     template<typename T>
-    uint32_t deserialize(const char* file_name, T** inptr, size_t& size ){
+    uint32_t deserialize(const char* file_name, T** inptr, size_t& size, uint64_t* generation = nullptr, bool copy = false, int locked_fd = -1){
         logi("Enter deserialize file_name: %s", file_name);
+        unmap(*inptr, size);
         errno = 0;
-        FILE *fileptr = std::fopen(file_name, "rb");
-        if(fileptr == 0) {
+        int fd = (locked_fd >= 0) ? locked_fd : open(file_name, O_RDONLY | O_CLOEXEC);
+        if(fd < 0){
             loge("deserialize - Failed to open file: %s errno: %d errorstr: %s", file_name, errno, std::strerror(errno));
             return errno;
         }
-
-        int fd = fileno(fileptr);
-        if (flock(fd, LOCK_SH) == -1) // lock is automatically released after fclose
+        if(copy && locked_fd < 0 && flock(fd, LOCK_SH) == -1) // lock is released on close
             loge("deserialize - Shared file lock failed errno: %d", errno);
 
-        size = 0;
-        if(std::fread(&size, sizeof(size), 1, fileptr) != 1){
-            loge("deserialize - fread failed - errno: %d", errno);
-            std::fclose(fileptr);
-            return errno;
+        struct stat file_stat;
+        if(fstat(fd, &file_stat) != 0 || (size_t)file_stat.st_size < sizeof(size_t)){
+            loge("deserialize - %s is truncated", file_name);
+            if(locked_fd < 0)
+                close(fd);
+            return FError::BAD_FORMAT;
+        }
+        size_t file_size = file_stat.st_size;
+        char* base = nullptr;
+        if(copy){
+            base = static_cast<char*>(mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+            if(base != MAP_FAILED && pread(fd, base, file_size, 0) != (ssize_t)file_size){
+                errno = errno ? errno : (int)FError::IO_ERROR;
+                munmap(base, file_size);
+                base = static_cast<char*>(MAP_FAILED);
+            }
+        }
+        else
+            base = static_cast<char*>(mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0));
+        uint32_t result = errno;
+        if(locked_fd < 0)
+            close(fd); // mapping keeps the file
+        if(base == MAP_FAILED){
+            loge("deserialize - mmap failed - errno: %d", result);
+            return result;
+        }
+
+        const TableHeader* header = reinterpret_cast<const TableHeader*>(base);
+        size_t legacy_count = *reinterpret_cast<const size_t*>(base);
+        size_t offset = 0;
+        size_t count = 0;
+        if(file_size >= sizeof(TableHeader) && header->magic == TableHeader::MAGIC){
+            if(header->version != T::SCHEMA_VERSION || header->recordSize != sizeof(T) || header->count > file_size/sizeof(T)
+                || (header->indexes != 0 && header->indexes != TableIndex<T>::COUNT)
+                || file_size != sizeof(TableHeader) + header->count*sizeof(T) + indexesSize<T>(header->indexes, header->count)){
+                loge("deserialize - %s has schema %d of %d byte records, expected %d of %ld", file_name, header->version, header->recordSize, T::SCHEMA_VERSION, sizeof(T));
+                munmap(base, file_size);
+                return FError::BAD_FORMAT;
+            }
+            offset = sizeof(TableHeader);
+            count = header->count;
+            if(generation)
+                *generation = header->generation;
+        }
+        else if(T::SCHEMA_VERSION == 1 && legacy_count <= file_size/sizeof(T) && file_size == sizeof(size_t) + legacy_count*sizeof(T)){
+            // headerless tables predate schema 2, only records still at schema 1 can be read from them
+            logw("deserialize - %s has no header, reading table of earlier version", file_name);
+            offset = sizeof(size_t);
+            count = legacy_count;
+            if(generation)
+                *generation = 0;
+        }
+        else{
+            loge("deserialize - %s is not a cssh table or was written on a host of other byte order", file_name);
+            munmap(base, file_size);
+            return FError::BAD_FORMAT;
         }
 
-        if(size == 0){
+        if(count == 0){
             logw("deserialize - reading empty file: %s", file_name);
-            return errno;
+            munmap(base, file_size);
+            return FError::NO_ERROR;
         }
+        *inptr = reinterpret_cast<T*>(base + offset);
+        size = count;
+        return FError::NO_ERROR;
+    }
 
-        *inptr = new T[size];
-        if(std::fread(*inptr, sizeof(T), size, fileptr) != size){
-            loge("deserialize - fread failed - errno: %d", errno);
-            std::fclose(fileptr);
-            delete[] *inptr;
-            *inptr = nullptr;
-            return errno;
+    // header of a table mapped by deserialize, nullptr for a headerless table of earlier version. Records start
+    // within first page of the mapping, right after the header
+    template<typename T>
+    const TableHeader* tableHeader(const T* table){
+        uintptr_t page_size = sysconf(_SC_PAGESIZE);
+        const char* base = reinterpret_cast<const char*>(reinterpret_cast<uintptr_t>(table) & ~(page_size - 1));
+        return (reinterpret_cast<const char*>(table) - base == sizeof(TableHeader)) ? reinterpret_cast<const TableHeader*>(base) : nullptr;
+    }
+
+    // release table mapped by deserialize
+    template<typename T>
+    void unmap(T*& ptr, size_t& size){
+        if(ptr){
+            uintptr_t page_size = sysconf(_SC_PAGESIZE);
+            const TableHeader* header = tableHeader(ptr);
+            char* base = reinterpret_cast<char*>(reinterpret_cast<uintptr_t>(ptr) & ~(page_size - 1));
+            munmap(base, reinterpret_cast<char*>(ptr + size) - base + (header ? indexesSize<T>(header->indexes, size) : 0));
+        }
+        ptr = nullptr;
+        size = 0;
+    }
+
+    template<typename T>
+    bool writeIndexes(FILE* fileptr, const T* table, size_t size){
+        std::vector<IndexSlot> slots;
+        std::vector<uint32_t> next;
+        for(uint32_t key = 0; key < TableIndex<T>::COUNT; key++){
+            buildIndex(table, size, key, slots, next);
+            if(std::fwrite(slots.data(), sizeof(IndexSlot), slots.size(), fileptr) != slots.size()
+                || (size != 0 && std::fwrite(next.data(), sizeof(uint32_t), size, fileptr) != size))
+                return false;
+        }
+        return true;
+    }
+
+    // free slots are listed in table order
+    bool writeIndexes(FILE* fileptr, const DeviceInUseInfo* table, size_t size){
+        InUseDirectory directory = {0, 0};
+        size_t mask = indexSlots(size) - 1;
+        std::vector<IndexSlot> macs(mask + 1, IndexSlot{0, 0});
+        std::vector<uint32_t> next_free(size, 0);
+        for(size_t i = size; i-- > 0;){
+            if(table[i].startTime == 0){
+                next_free[i] = directory.freeHead;
+                directory.freeHead = i + 1;
+                continue;
+            }
+            uint32_t hash = TableIndex<DeviceInUseInfo>::hash(table[i], TableIndex<DeviceInUseInfo>::MAC);
+            size_t slot = hash & mask;
+            while(macs[slot].record != 0)
+                slot = (slot + 1) & mask;
+            macs[slot] = IndexSlot{hash, static_cast<uint32_t>(i + 1)};
+        }
+        return std::fwrite(&directory, sizeof(directory), 1, fileptr) == 1
+            && std::fwrite(macs.data(), sizeof(IndexSlot), macs.size(), fileptr) == macs.size()
+            && (size == 0 || std::fwrite(next_free.data(), sizeof(uint32_t), size, fileptr) == size);
+    }
+
+    // records are chained backwards so each chain keeps table order
+    template<typename T>
+    void buildIndex(const T* table, size_t size, uint32_t key, std::vector<IndexSlot>& slots, std::vector<uint32_t>& next){
+        size_t mask = indexSlots(size) - 1;
+        slots.assign(mask + 1, IndexSlot{0, 0});
+        next.assign(size, 0);
+        for(size_t i = size; i-- > 0;){
+            uint32_t hash = TableIndex<T>::hash(table[i], key);
+            size_t slot = hash & mask;
+            while(slots[slot].record != 0 && slots[slot].hash != hash)
+                slot = (slot + 1) & mask;
+            next[i] = slots[slot].record;
+            slots[slot] = IndexSlot{hash, static_cast<uint32_t>(i + 1)};
+        }
+    }
+
+    // slots of key's index in a mapped table and its per record chain, nullptr when table was published without
+    template<typename T>
+    const IndexSlot* indexSection(const T* table, size_t size, uint32_t key, const uint32_t*& next){
+        const TableHeader* header = table ? tableHeader(table) : nullptr;
+        if(!header || header->indexes != TableIndex<T>::COUNT || key >= header->indexes || indexesSize<T>(1, size) != indexSize(size))
+            return nullptr; // in-use directory is no hash index
+        const char* section = reinterpret_cast<const char*>(table + size) + key*indexSize(size);
+        next = reinterpret_cast<const uint32_t*>(section + indexSlots(size)*sizeof(IndexSlot));
+        return reinterpret_cast<const IndexSlot*>(section);
+    }
+
+    // first record of a mapped table whose key hashes to hash, size if none. Callers compare the key itself,
+    // distinct keys of same hash share a chain. Tables without indexes are scanned
+    template<typename T>
+    size_t findRecord(const T* table, size_t size, uint32_t key, uint32_t hash){
+        const uint32_t* next = nullptr;
+        const IndexSlot* slots = indexSection(table, size, key, next);
+        if(!slots){
+            for(size_t i = 0; i < size; i++){
+                if(TableIndex<T>::hash(table[i], key) == hash)
+                    return i;
+            }
+            return size;
+        }
+        size_t mask = indexSlots(size) - 1;
+        for(size_t slot = hash & mask; slots[slot].record != 0; slot = (slot + 1) & mask){
+            if(slots[slot].hash == hash)
+                return slots[slot].record - 1;
         }
-        std::fclose(fileptr);
-        return errno; 
+        return size;
+    }
+
+    // next record after index with same key hash, size if none
+    template<typename T>
+    size_t nextRecord(const T* table, size_t size, uint32_t key, size_t index){
+        const uint32_t* next = nullptr;
+        if(!indexSection(table, size, key, next)){
+            uint32_t hash = TableIndex<T>::hash(table[index], key);
+            for(size_t i = index + 1; i < size; i++){
+                if(TableIndex<T>::hash(table[i], key) == hash)
+                    return i;
+            }
+            return size;
+        }
+        return (next[index] != 0) ? next[index] - 1 : size;
+    }
+
+    void loadRttHistory(RttHistoryMap& history){
+        logi("Enter loadRttHistory");
+        RttHistory* history_ptr = nullptr;
+        size_t history_size = 0;
+        struct in_addr addr;
+        FError result = static_cast<FError>(deserialize<RttHistory>(m_rtt_history_filename, &history_ptr, history_size));
+        if(result != FError::NO_ERROR && result != FError::NO_FILE)
+            logw("loadRttHistory - deserialize failed - %d, starting with empty history", result);
+
+        for(size_t i = 0; i < history_size; i++){
+            if(inet_pton(AF_INET, (history_ptr+i)->ip, &addr) == 1)
+                history[addr.s_addr] = *(history_ptr+i);
+        }
+        unmap(history_ptr, history_size);
+    }
+
+    void saveRttHistory(const RttHistoryMap& history){
+        logi("Enter saveRttHistory size: %ld", history.size());
+        std::vector<RttHistory> entries;
+        entries.reserve(history.size());
+        for(const auto& entry : history)
+            entries.push_back(entry.second);
+        if(serialize<RttHistory>(m_rtt_history_filename, entries.data(), entries.size()) != FError::NO_ERROR)
+            logw("saveRttHistory - serialize failed");
+    }
+
+    void loadNegativeCache(NegativeCache& negative){
+        logi("Enter loadNegativeCache");
+        NegativeCacheInfo* negative_ptr = nullptr;
+        size_t negative_size = 0;
+        FError result = static_cast<FError>(deserialize<NegativeCacheInfo>(m_negative_cache_filename, &negative_ptr, negative_size));
+        if(result != FError::NO_ERROR && result != FError::NO_FILE)
+            logw("loadNegativeCache - deserialize failed - %d, starting with empty negative cache", result);
+        if(negative_ptr)
+            negative.load(negative_ptr, negative_size);
+        unmap(negative_ptr, negative_size);
+    }
+
+    void saveNegativeCache(NegativeCache& negative){
+        logi("Enter saveNegativeCache");
+        std::vector<NegativeCacheInfo> entries = negative.entries();
+        if(serialize<NegativeCacheInfo>(m_negative_cache_filename, entries.data(), entries.size()) != FError::NO_ERROR)
+            logw("saveNegativeCache - serialize failed");
     }
 
     bool getSno(uint32_t &sno){
@@ -266,6 +785,416 @@ class Device {
         return file_exist;
     }
 
+    // exclusive flock on a lock file, -1 if lock file is unusable
+    int lockFile(const char* file_name){
+        errno = 0;
+        int fd = open(file_name, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if(fd < 0 || flock(fd, LOCK_EX) != 0){
+            loge("lockFile - lock %s failed errno: %d", file_name, errno);
+            if(fd >= 0)
+                close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    void unlockFile(int fd){
+        if(fd >= 0)
+            close(fd); // releases flock
+    }
+
+    // one time conversion of an in-use table written by an earlier build into slots, so its sessions stay in use.
+    // Republished only over the generation it was read from. BAD_FORMAT if it is no in-use table of any schema
+    uint32_t migrateInUseTable(void){
+        logi("Enter migrateInUseTable");
+        std::vector<char> content;
+        {
+            errno = 0;
+            int fd = open(m_device_in_use_filename, O_RDONLY | O_CLOEXEC);
+            if(fd < 0)
+                return errno;
+            struct stat file_stat;
+            if(flock(fd, LOCK_SH) == -1) // lock is released on close
+                loge("migrateInUseTable - Shared file lock failed errno: %d", errno);
+            if(fstat(fd, &file_stat) == 0)
+                content.resize(file_stat.st_size);
+            bool read_all = pread(fd, content.data(), content.size(), 0) == (ssize_t)content.size();
+            close(fd);
+            if(!read_all){
+                loge("migrateInUseTable - read of %s failed - errno: %d", m_device_in_use_filename, errno);
+                return errno ? errno : (uint32_t)FError::IO_ERROR;
+            }
+        }
+
+        TableHeader header = {};
+        size_t legacy_count = 0;
+        if(content.size() >= sizeof(header))
+            memcpy(&header, content.data(), sizeof(header));
+        if(content.size() >= sizeof(legacy_count))
+            memcpy(&legacy_count, content.data(), sizeof(legacy_count));
+        // serialize compares the same bytes, a table republished meanwhile is not overwritten
+        uint64_t generation = header.generation;
+        uint32_t version = 0;
+        size_t offset = sizeof(TableHeader), count = 0;
+        if(header.magic == TableHeader::MAGIC && header.version < DeviceInUseInfo::SCHEMA_VERSION){
+            size_t record_size = (header.version == 1) ? sizeof(DeviceInUseInfoV1) : (header.version == 2) ? sizeof(DeviceInUseInfoV2) : sizeof(DeviceInUseInfo);
+            if(header.recordSize == record_size && header.count <= (content.size() - offset)/record_size){
+                version = header.version;
+                count = header.count;
+            }
+        }
+        else if(header.magic != TableHeader::MAGIC && content.size() >= sizeof(legacy_count)
+            && legacy_count <= content.size()/sizeof(DeviceInUseInfoV1) && content.size() == sizeof(legacy_count) + legacy_count*sizeof(DeviceInUseInfoV1)){
+            version = 1;
+            offset = sizeof(legacy_count);
+            count = legacy_count;
+        }
+        if(version == 0){
+            logw("migrateInUseTable - %s is no in-use table of an earlier schema", m_device_in_use_filename);
+            return FError::BAD_FORMAT;
+        }
+
+        std::vector<DeviceInUseInfo> slots(std::max<size_t>(2*count, 8));
+        size_t used = 0;
+        for(size_t i = 0; i < count; i++){
+            DeviceInUseInfo& slot = slots[used];
+            if(version == 1){
+                DeviceInUseInfoV1 record;
+                memcpy(&record, content.data() + offset + i*sizeof(record), sizeof(record));
+                slot.startTime = TimeUtil::fromUTC(std::string(record.startTime, strnlen(record.startTime, sizeof(record.startTime))).c_str());
+                slot.ip = AddrUtil::parseIp(std::string(record.ip, strnlen(record.ip, sizeof(record.ip))).c_str());
+                slot.processId = record.processId;
+                slot.pmiId = internPmi(std::string(record.pmi, strnlen(record.pmi, sizeof(record.pmi))).c_str());
+                AddrUtil::parseMac(std::string(record.mac, strnlen(record.mac, sizeof(record.mac))).c_str(), slot.mac);
+                memcpy(slot.ntid, record.ntid, sizeof(slot.ntid));
+            }
+            else if(version == 2){
+                DeviceInUseInfoV2 record;
+                memcpy(&record, content.data() + offset + i*sizeof(record), sizeof(record));
+                slot.startTime = record.startTime;
+                slot.ip = record.ip;
+                slot.processId = record.processId;
+                slot.pmiId = internPmi(std::string(record.pmi, strnlen(record.pmi, sizeof(record.pmi))).c_str());
+                memcpy(slot.mac, record.mac, sizeof(slot.mac));
+                memcpy(slot.ntid, record.ntid, sizeof(slot.ntid));
+            }
+            else
+                memcpy(&slot, content.data() + offset + i*sizeof(slot), sizeof(slot));
+            slot.ntid[sizeof(slot.ntid) - 1] = '\0';
+            // a session without start time would read as a free slot
+            if(slot.startTime == 0)
+                slot.startTime = 1;
+            if(AddrUtil::isKnownMac(slot.mac))
+                used++;
+            else
+                slot = DeviceInUseInfo{};
+        }
+
+        logw("migrateInUseTable - carrying %ld sessions of schema %d over into %ld slots", used, version, slots.size());
+        return serialize<DeviceInUseInfo>(m_device_in_use_filename, slots.data(), slots.size(), generation);
+    }
+
+    // copy of in-use table (see deserialize), a table of an earlier build is migrated first
+    uint32_t loadInUseTable(DeviceInUseInfo** inptr, size_t& size){
+        uint32_t result = deserialize<DeviceInUseInfo>(m_device_in_use_filename, inptr, size, nullptr, true);
+        if(result == FError::BAD_FORMAT){
+            result = migrateInUseTable();
+            // STALE: another run published a table meanwhile, read that one
+            if(result == FError::NO_ERROR || result == FError::STALE)
+                result = deserialize<DeviceInUseInfo>(m_device_in_use_filename, inptr, size, nullptr, true);
+        }
+        return result;
+    }
+
+    // in-use table is slotted: a session stores its record into a free slot and close stores a free (all zero) one
+    // over it, under exclusive lock of the table. Slot of mac and a free slot are found through the InUseDirectory,
+    // so a store reads and writes the header, the directory entries it probes and one slot, nothing else. Readers
+    // copy the table under shared lock so they never see half a slot. Table is republished only when no slot is
+    // free, with twice the slots, or when tombstones fill half of the directory. Generation is bumped by every
+    // store so that republish never drops a slot stored meanwhile
+    uint32_t storeInUseSlot(const uint8_t* mac, const DeviceInUseInfo& record){
+        logi("Enter storeInUseSlot mac: %s, ntid: %s", AddrUtil::macToString(mac).c_str(), record.ntid);
+        bool release = record.startTime == 0;
+        uint32_t hash = keyHash(mac, 6);
+        for(;;){
+            errno = 0;
+            int fd = open(m_device_in_use_filename, O_RDWR | O_CLOEXEC);
+            if(fd < 0 && errno != FError::NO_FILE){
+                loge("storeInUseSlot - Failed to open file: %s errno: %d", m_device_in_use_filename, errno);
+                return errno;
+            }
+            struct stat locked_stat, file_stat;
+            if(fd >= 0){
+                if(flock(fd, LOCK_EX) == -1) // lock is released on close
+                    loge("storeInUseSlot - Exclusive file lock failed errno: %d", errno);
+                // table may have been republished while waiting for the lock
+                if(fstat(fd, &locked_stat) != 0 || stat(m_device_in_use_filename, &file_stat) != 0 || locked_stat.st_ino != file_stat.st_ino){
+                    close(fd);
+                    continue;
+                }
+            }
+            auto readAt = [fd](void* data, size_t len, size_t offset){ return pread(fd, data, len, offset) == (ssize_t)len; };
+            auto writeAt = [fd](const void* data, size_t len, size_t offset){ return pwrite(fd, data, len, offset) == (ssize_t)len; };
+
+            TableHeader header = {};
+            uint32_t result = (fd < 0) ? (uint32_t)FError::NO_FILE : FError::NO_ERROR;
+            if(fd >= 0 && !readAt(&header, sizeof(header), 0))
+                result = (errno != 0) ? errno : (uint32_t)FError::BAD_FORMAT; // shorter than a header
+            else if(fd >= 0 && (header.magic != TableHeader::MAGIC || header.version != DeviceInUseInfo::SCHEMA_VERSION
+                || header.recordSize != sizeof(DeviceInUseInfo) || header.indexes != TableIndex<DeviceInUseInfo>::COUNT || header.count >= InUseDirectory::TOMBSTONE/2
+                || (size_t)locked_stat.st_size != sizeof(TableHeader) + header.count*sizeof(DeviceInUseInfo) + inUseDirectorySize(header.count)))
+                result = FError::BAD_FORMAT;
+            if(result != FError::NO_ERROR){
+                if(fd >= 0)
+                    close(fd);
+                // table of an earlier build keeps its sessions, also to release one of them
+                if(result == FError::BAD_FORMAT){
+                    uint32_t migrated = migrateInUseTable();
+                    if(migrated == FError::NO_ERROR || migrated == FError::STALE || migrated == FError::NO_FILE)
+                        continue;
+                    if(migrated != FError::BAD_FORMAT)
+                        return migrated;
+                }
+                if(release)
+                    return (result == FError::NO_FILE) ? (uint32_t)FError::NO_ERROR : result;
+                // any other error leaves the table alone, its sessions may still be live
+                if(result != FError::NO_FILE && result != FError::BAD_FORMAT){
+                    loge("storeInUseSlot - read of %s failed - %d", m_device_in_use_filename, result);
+                    return result;
+                }
+                // table is not a cssh table, start an empty one
+                logw("storeInUseSlot - starting empty %s - %d", m_device_in_use_filename, result);
+                if((result = serialize<DeviceInUseInfo>(m_device_in_use_filename, (DeviceInUseInfo*)nullptr, 0)) != FError::NO_ERROR)
+                    return result;
+                continue;
+            }
+
+            size_t count = header.count;
+            size_t mask = indexSlots(count) - 1;
+            size_t directory_at = sizeof(TableHeader) + count*sizeof(DeviceInUseInfo);
+            size_t macs_at = directory_at + sizeof(InUseDirectory);
+            size_t free_at = macs_at + (mask + 1)*sizeof(IndexSlot);
+            InUseDirectory directory;
+            bool ok = readAt(&directory, sizeof(directory), directory_at);
+
+            // probe macs for slot of mac, first empty or tombstone entry is where a new mac goes
+            size_t slot = -1, entry_at = -1, insert_at = -1;
+            bool insert_tombstone = false;
+            for(size_t probe = hash & mask, n = 0; ok && n <= mask; probe = (probe + 1) & mask, n++){
+                IndexSlot entry;
+                if(!(ok = readAt(&entry, sizeof(entry), macs_at + probe*sizeof(entry))))
+                    break;
+                if(entry.record == 0 || entry.record == InUseDirectory::TOMBSTONE){
+                    if(insert_at == (size_t)-1){
+                        insert_at = probe;
+                        insert_tombstone = (entry.record == InUseDirectory::TOMBSTONE);
+                    }
+                    if(entry.record == 0)
+                        break;
+                    continue;
+                }
+                DeviceInUseInfo current;
+                if(entry.hash == hash && entry.record <= count && (ok = readAt(&current, sizeof(current), sizeof(TableHeader) + (entry.record - 1)*sizeof(current)))
+                    && !memcmp(current.mac, mac, 6)){
+                    slot = entry.record - 1;
+                    entry_at = probe;
+                    break;
+                }
+            }
+            if(ok && release && slot == (size_t)-1){
+                close(fd);
+                return FError::NO_ERROR;
+            }
+
+            if(ok && ((slot == (size_t)-1 && directory.freeHead == 0) || directory.tombstones > count/2)){
+                // republish: slot of mac, else first free one, else first of the new slots
+                std::vector<DeviceInUseInfo> slots(count);
+                if(count != 0 && !readAt(slots.data(), count*sizeof(DeviceInUseInfo), sizeof(TableHeader))){
+                    result = (errno != 0) ? errno : (uint32_t)FError::IO_ERROR;
+                    close(fd);
+                    return result;
+                }
+                if(slot == (size_t)-1 && directory.freeHead != 0)
+                    slot = directory.freeHead - 1;
+                if(slot == (size_t)-1){
+                    slot = count;
+                    slots.resize(std::max<size_t>(2*count, 8));
+                }
+                slots[slot] = record;
+                close(fd); // serialize takes the lock itself
+                result = serialize<DeviceInUseInfo>(m_device_in_use_filename, slots.data(), slots.size(), header.generation);
+                if(result == FError::STALE)
+                    continue;
+                return result;
+            }
+
+            if(ok && slot == (size_t)-1){
+                // take head of free list, mac goes into the directory
+                slot = directory.freeHead - 1;
+                uint32_t next_free = 0;
+                IndexSlot entry = {hash, static_cast<uint32_t>(slot + 1)};
+                ok = slot < count && insert_at != (size_t)-1 && readAt(&next_free, sizeof(next_free), free_at + slot*sizeof(next_free))
+                    && writeAt(&entry, sizeof(entry), macs_at + insert_at*sizeof(entry));
+                directory.freeHead = next_free;
+                if(insert_tombstone)
+                    directory.tombstones--;
+            }
+            else if(ok && release){
+                // mac leaves a tombstone, slot goes to head of free list
+                IndexSlot entry = {hash, InUseDirectory::TOMBSTONE};
+                uint32_t next_free = directory.freeHead;
+                ok = writeAt(&entry, sizeof(entry), macs_at + entry_at*sizeof(entry))
+                    && writeAt(&next_free, sizeof(next_free), free_at + slot*sizeof(next_free));
+                directory.freeHead = slot + 1;
+                directory.tombstones++;
+            }
+            uint64_t generation = header.generation + 1;
+            ok = ok && writeAt(&record, sizeof(record), sizeof(TableHeader) + slot*sizeof(record))
+                && writeAt(&directory, sizeof(directory), directory_at)
+                && writeAt(&generation, sizeof(generation), offsetof(TableHeader, generation))
+                && fdatasync(fd) == 0;
+            result = ok ? (uint32_t)FError::NO_ERROR : (errno ? errno : (uint32_t)FError::IO_ERROR);
+            if(!ok)
+                loge("storeInUseSlot - store of slot %ld failed - errno: %d", slot, errno);
+            close(fd);
+            return result;
+        }
+    }
+
+    // id of a name in names dictionary, 0 if it is not there
+    uint32_t nameId(const char* name, NameInfo::Kind kind){
+        const uint32_t NAME = TableIndex<NameInfo>::NAME;
+        for(size_t i = findRecord(m_names_ptr, m_names_size, NAME, keyHash(name)); i < m_names_size; i = nextRecord(m_names_ptr, m_names_size, NAME, i)){
+            if((m_names_ptr+i)->kind == kind && !strcmp((m_names_ptr+i)->name, name))
+                return i + 1;
+        }
+        return 0;
+    }
+
+    const char* nameOf(uint32_t id){
+        return (id != 0 && id <= m_names_size) ? (m_names_ptr+id-1)->name : "NA";
+    }
+
+    // read-modify-write of names dictionary under its lock, so names appended by concurrent runs never share an id.
+    // update gets latest names and returns true when it changed them, dictionary is remapped after publish
+    bool updateNames(const std::function<bool(std::vector<NameInfo>&)>& update){
+        logi("Enter updateNames");
+        int lock_fd = lockFile(m_names_lock_filename);
+        if(lock_fd < 0){
+            // unlocked append could hand out an id another run hands out as well
+            loge("updateNames - names dictionary not updated, lock failed");
+            return false;
+        }
+        FError result = static_cast<FError>(deserialize<NameInfo>(m_names_filename, &m_names_ptr, m_names_size));
+        if(result != FError::NO_ERROR && result != FError::NO_FILE){
+            // republishing would hand out ids that records already refer to
+            loge("updateNames - deserialize failed - %d", result);
+            unlockFile(lock_fd);
+            return false;
+        }
+
+        std::vector<NameInfo> names(m_names_ptr, m_names_ptr + m_names_size);
+        bool published = true;
+        if(update(names)){
+            published = serialize<NameInfo>(m_names_filename, names.data(), names.size()) == FError::NO_ERROR;
+            if(!published)
+                loge("updateNames - serialize failed");
+            deserialize<NameInfo>(m_names_filename, &m_names_ptr, m_names_size);
+        }
+        unlockFile(lock_fd);
+        return published;
+    }
+
+    // id of a pmi read from a device, appended to names dictionary when new, 0 if pmi can not be stored.
+    // Safe from pmi worker threads, no other dictionary lookup may run meanwhile as appending remaps it
+    uint32_t internPmi(const char* pmi){
+        std::lock_guard<std::mutex> lock(m_names_mutex);
+        if(pmi[0] == '\0' || strlen(pmi) >= sizeof(NameInfo::name)){
+            logw("internPmi - invalid pmi: %s", pmi);
+            return 0;
+        }
+
+        uint32_t id = nameId(pmi, NameInfo::PMI);
+        if(id != 0)
+            return id;
+
+        bool published = updateNames([&](std::vector<NameInfo>& names){
+            id = nameId(pmi, NameInfo::PMI); // another run may have appended it meanwhile
+            if(id != 0)
+                return false;
+            NameInfo name = {NameInfo::PMI, 0, {}};
+            strcpy(name.name, pmi);
+            names.push_back(name);
+            id = names.size();
+            return true;
+        });
+        return published ? id : 0;
+    }
+
+    // friendly names are kept in names dictionary, friendly_names.config is parsed again only when its mtime/size
+    // differ from the stamp stored with names it was last synced into. Returns false when config file is missing
+    bool loadModelNames(void){
+        logi("Enter loadModelNames");
+        FError result = static_cast<FError>(deserialize<NameInfo>(m_names_filename, &m_names_ptr, m_names_size));
+        if(result != FError::NO_ERROR && result != FError::NO_FILE)
+            loge("loadModelNames - deserialize names failed - %d", result);
+
+        struct stat config_stat;
+        if(stat(m_model_names_filename, &config_stat) != 0){
+            loge("model name file: %s do not exist", m_model_names_filename);
+            return false;
+        }
+        char stamp[sizeof(NameInfo::name)];
+        snprintf(stamp, sizeof(stamp), "%lx.%lx:%lx", (long)config_stat.st_mtim.tv_sec, (long)config_stat.st_mtim.tv_nsec, (long)config_stat.st_size);
+        for(size_t i = 0; i < m_names_size; i++){
+            if((m_names_ptr+i)->kind == NameInfo::CONFIG && !strcmp((m_names_ptr+i)->name, stamp))
+                return true;
+        }
+
+        parseModelNames();
+        updateNames([&](std::vector<NameInfo>& names){
+            // lookup covering names appended by this update, which are not in the mapping yet
+            auto intern = [&](const std::string& name, NameInfo::Kind kind) -> uint32_t {
+                uint32_t id = nameId(name.c_str(), kind);
+                for(size_t i = m_names_size; id == 0 && i < names.size(); i++){
+                    if(names[i].kind == kind && name == names[i].name)
+                        id = i + 1;
+                }
+                if(id == 0){
+                    NameInfo entry = {kind, 0, {}};
+                    strcpy(entry.name, name.c_str());
+                    names.push_back(entry);
+                    id = names.size();
+                }
+                return id;
+            };
+
+            // friendly names dropped from config stop resolving, ids stay reserved
+            for(NameInfo& name : names){
+                if(name.kind == NameInfo::FRIENDLY)
+                    name.pmiId = 0;
+            }
+            for(const auto& model : m_model_name_pmi_map){
+                if(model.first.size() >= sizeof(NameInfo::name) || model.second.size() >= sizeof(NameInfo::name)){
+                    logw("loadModelNames - %s = %s too long, skipped", model.first.c_str(), model.second.c_str());
+                    continue;
+                }
+                uint32_t pmi_id = intern(model.second, NameInfo::PMI);
+                uint32_t friendly_id = intern(model.first, NameInfo::FRIENDLY);
+                names[friendly_id-1].pmiId = pmi_id;
+            }
+
+            auto config = std::find_if(names.begin(), names.end(), [](const NameInfo& name){ return name.kind == NameInfo::CONFIG; });
+            if(config == names.end()){
+                names.push_back(NameInfo{NameInfo::CONFIG, 0, {}});
+                config = names.end() - 1;
+            }
+            strcpy(config->name, stamp);
+            return true;
+        });
+        return true;
+    }
+
     bool updateEntry(LoginRecordInfo& entry){
         logi("Enter updateEntry");
         FILE* login_record_fileptr = 0;
@@ -287,7 +1216,8 @@ class Device {
             getSno(sno);
             sno++;
             setSno(sno);
-            std::fprintf(login_record_fileptr, "%d,%s,%s,%s,%s,%s,%s\n", sno, entry.ntid, entry.ip, entry.mac, entry.startTime, entry.endTime, entry.logoutType);
+            std::fprintf(login_record_fileptr, "%d,%s,%s,%s,%s,%s,%s\n", sno, entry.ntid, AddrUtil::ipToString(entry.ip).c_str(), AddrUtil::macToString(entry.mac).c_str()
+                , TimeUtil::toUTC(entry.startTime).c_str(), TimeUtil::toUTC(entry.endTime).c_str(), entry.logoutType);
         }
         else{
             loge("updateEntry - frpintf failed with errno: %d", errno);
@@ -303,9 +1233,13 @@ class Device {
         : m_friendly_name(device_name)
         , m_ntid(ntid)
     {
-        parseModelNames();
-        if( m_model_name_pmi_map.find(m_friendly_name) != m_model_name_pmi_map.end() )
-            m_pmi = m_model_name_pmi_map[m_friendly_name];
+        if(loadModelNames()){
+            uint32_t friendly_id = nameId(m_friendly_name.c_str(), NameInfo::FRIENDLY);
+            if(friendly_id != 0 && (m_names_ptr+friendly_id-1)->pmiId != 0){
+                m_pmi_id = (m_names_ptr+friendly_id-1)->pmiId;
+                m_pmi = nameOf(m_pmi_id);
+            }
+        }
         
         logi("Device Ctor pmi: %s homeDir: %s, prefixPath: %s, cacheFilename: %s, inuseFilename: %s, loginRecordFilename: %s, loginRecordSnoFilename: %s, friendlyConfigFilename: %s", m_pmi.c_str(), homeDir, prefixPath.c_str(), m_device_cache_filename, m_device_in_use_filename, m_login_record_filename, m_login_record_sno_filename, m_model_names_filename);
     }
@@ -313,17 +1247,18 @@ class Device {
     Device(std::string& ntid)
         : m_ntid(ntid)
     { 
-        parseModelNames();
+        loadModelNames();
         logi("Device Ctor pmi: %s homeDir: %s, prefixPath: %s, cacheFilename: %s, inuseFilename: %s, loginRecordFilename: %s, loginRecordSnoFilename: %s, friendlyConfigFilename: %s", m_pmi.c_str(), homeDir, prefixPath.c_str(), m_device_cache_filename, m_device_in_use_filename, m_login_record_filename, m_login_record_sno_filename, m_model_names_filename);
     }
 
     Device(){
-        parseModelNames();
+        loadModelNames();
         logi("Device Ctor pmi: %s homeDir: %s, prefixPath: %s, cacheFilename: %s, inuseFilename: %s, loginRecordFilename: %s, loginRecordSnoFilename: %s, friendlyConfigFilename: %s", m_pmi.c_str(), homeDir, prefixPath.c_str(), m_device_cache_filename, m_device_in_use_filename, m_login_record_filename, m_login_record_sno_filename, m_model_names_filename);
     }
 
     void cleanUp(void){
         logi("Enter cleanUp");
+        stopReachabilityProbe();
         if(m_device_cache_filename){
             free((void *)m_device_cache_filename);
             m_device_cache_filename = nullptr;
@@ -349,19 +1284,38 @@ class Device {
             m_model_names_filename = nullptr;
         }
 
-        if(m_device_cache_ptr){
-            delete[] m_device_cache_ptr;
-            m_device_cache_ptr = nullptr;
+        if(m_rtt_history_filename){
+            free((void *)m_rtt_history_filename);
+            m_rtt_history_filename = nullptr;
+        }
+
+        if(m_negative_cache_filename){
+            free((void *)m_negative_cache_filename);
+            m_negative_cache_filename = nullptr;
+        }
+
+        if(m_alloc_lock_filename){
+            free((void *)m_alloc_lock_filename);
+            m_alloc_lock_filename = nullptr;
+        }
+
+        if(m_names_filename){
+            free((void *)m_names_filename);
+            m_names_filename = nullptr;
         }
 
-        if(m_device_in_use_ptr){
-            delete[] m_device_in_use_ptr;
-            m_device_in_use_ptr = nullptr;
+        if(m_names_lock_filename){
+            free((void *)m_names_lock_filename);
+            m_names_lock_filename = nullptr;
         }
+
+        unmap(m_device_cache_ptr, m_device_cache_size);
+        unmap(m_device_in_use_ptr, m_device_in_use_size);
+        unmap(m_names_ptr, m_names_size);
     }   
 
     inline bool isKnownPmi(void){
-        return (m_model_name_pmi_map.find(m_friendly_name) != m_model_name_pmi_map.end());
+        return m_pmi_id != 0;
     }
 
     inline bool isDeviceCacheFileExist(void){
@@ -380,11 +1334,25 @@ class Device {
         return is_file_exists(m_model_names_filename);
     }
 
+    // tcp pre-probe of ssh port first, ssh is spawned only when sshd answered with its banner
+    // its ssh master is kept, sshDevice session then rides on the same connection
+    // result of speculative probe is used when one is running
     inline bool isDeviceReachable(void){
         logi("Enter isDeviceReachable");
         char cmdout[256];
+        char banner[64];
+        {
+            std::unique_lock<std::mutex> lock(m_reachability_mutex);
+            if(m_reachability.size() == m_available_devices.size() && m_user_requested_index < m_reachability.size()){
+                Reachability& reach = m_reachability[m_user_requested_index];
+                m_reachability_cv.wait(lock, [&]{ return reach.state == Reachability::REACHABLE || reach.state == Reachability::UNREACHABLE; });
+                logi("isDeviceReachable - speculative result: %d", reach.state);
+                return reach.state == Reachability::REACHABLE;
+            }
+        }
         if(!m_available_devices.empty()){
-            return System::getPmi(m_available_devices[m_user_requested_index].ip, cmdout);
+            std::string ip = AddrUtil::ipToString(m_available_devices[m_user_requested_index].ip);
+            return PortProbe::isOpen(ip.c_str(), System::m_port, m_port_probe_timeout_ms, banner) && System::getPmi(ip.c_str(), cmdout, sizeof(cmdout), m_pmi_deadline_s, true);
         }
         return false;
     }
@@ -392,8 +1360,9 @@ class Device {
     inline bool isDeviceReachable(std::string ip, int port = 10022){
         logi("Enter isDeviceReachable ip: %s, port: %d", ip.c_str(), port);
         char cmdout[256];
+        char banner[64];
         System::m_port = port;
-        return System::getPmi(ip.c_str(), cmdout);
+        return PortProbe::isOpen(ip.c_str(), port, m_port_probe_timeout_ms, banner) && System::getPmi(ip.c_str(), cmdout, sizeof(cmdout));
     }
     
     inline void setNewConnectionUserRequest(size_t index){
@@ -402,6 +1371,31 @@ class Device {
         m_request_type = RequestType::NEW_CONNECTION;
     }
 
+    inline void setScanRange(const std::string& ranges){
+        logi("Enter setScanRange ranges: %s", ranges.c_str());
+        m_scan_range = ranges;
+    }
+
+    inline void setScanMode(ScanMode mode){
+        logi("Enter setScanMode mode: %d", mode);
+        m_scan_mode = mode;
+    }
+
+    inline void setIncrementalScan(bool incremental){
+        logi("Enter setIncrementalScan incremental: %d", incremental);
+        m_incremental_scan = incremental;
+    }
+
+    inline void setModelMatches(size_t count){
+        logi("Enter setModelMatches count: %d", count);
+        m_model_matches = (count == 0) ? 1 : count;
+    }
+
+    inline void setPmiWorkers(size_t count){
+        logi("Enter setPmiWorkers count: %d", count);
+        m_pmi_workers = (count == 0) ? 1 : count;
+    }
+
     inline void setCloseConnectionUserRequest(size_t index){
         logi("Enter setCloseConnectionUserRequest index: %d", index);
         m_user_requested_index = index;
@@ -480,7 +1474,7 @@ class Device {
     bool sshDevice(void){
         logi("Enter sshDevice");
         if(!m_available_devices.empty()){
-            return System::execSsh(m_available_devices[m_user_requested_index].ip);
+            return System::execSsh(AddrUtil::ipToString(m_available_devices[m_user_requested_index].ip).c_str());
         }
         return false;
     }
@@ -494,8 +1488,8 @@ class Device {
 
         errno = 0;
         LoginRecordInfo entry;
-        DeviceInUseInfo* device_in_use_ptr = nullptr;
-        const char* timeStamp = TimeUtil::nowUTC();
+        DeviceInUseInfo slot = {};  // stays free for close
+        time_t now = time(nullptr);
 
         if(m_request_type == RequestType::NEW_CONNECTION){
             if(m_available_devices.empty()){
@@ -503,67 +1497,39 @@ class Device {
                 return false;
             }
 
+            // a device already in use keeps its slot, current user id, start time and process id are stored over it
+            slot.pmiId = m_pmi_id;
+            strcpy(slot.ntid, m_ntid.c_str());
+            slot.ip = m_available_devices[m_user_requested_index].ip;
+            memcpy(slot.mac, m_available_devices[m_user_requested_index].mac, 6);
+            slot.startTime = now;
+            slot.processId = m_detached_session ? 0 : getpid();
+
             if(m_available_devices[m_user_requested_index].isBeingUsed){
 
                 strcpy(entry.ntid, m_available_devices[m_user_requested_index].ntid); // previous user of the device
-                strcpy(entry.pmi, m_pmi.c_str());
-                strcpy(entry.ip, m_available_devices[m_user_requested_index].ip);
-                strcpy(entry.mac, m_available_devices[m_user_requested_index].mac);
-                strcpy(entry.startTime, m_available_devices[m_user_requested_index].startTime);
-                strcpy(entry.endTime, timeStamp);
+                entry.pmiId = m_pmi_id;
+                entry.ip = m_available_devices[m_user_requested_index].ip;
+                memcpy(entry.mac, m_available_devices[m_user_requested_index].mac, sizeof(entry.mac));
+                entry.startTime = m_available_devices[m_user_requested_index].startTime;
+                entry.endTime = now;
                 strcpy(entry.logoutType, "FORCED");
 
-                if(m_device_in_use_ptr){
-                    for(size_t i = 0; i < m_device_in_use_size; i++){
-                        // if device is already available in device in use cache, update current user id,start time and process id
-                        if(!strcmp((m_device_in_use_ptr+i)->mac, m_available_devices[m_user_requested_index].mac)){
-                            strcpy((m_device_in_use_ptr+i)->ntid, m_ntid.c_str());
-                            strcpy((m_device_in_use_ptr+i)->startTime, timeStamp);
-                            (m_device_in_use_ptr+i)->processId = getpid();
-                            break;
-                        }
-                    }
-                }
-                
                 logw("Killing ssh session for user: %s", m_available_devices[m_user_requested_index].ntid);
                 if(!System::logOut(m_available_devices[m_user_requested_index].processId)){
                     logw("Killing ssh session (pid: %d) user: %s failed !", m_available_devices[m_user_requested_index].processId, m_available_devices[m_user_requested_index].ntid);
                     // return false;
                 }
-
-                if(serialize<DeviceInUseInfo>(m_device_in_use_filename, m_device_in_use_ptr, m_device_in_use_size) != FError::NO_ERROR){
-                    loge("updateUserAccess - serialize failed");
-                    return false;
-                }
-
-                if(!updateEntry(entry)){
-                    loge("updateUserAccess - updateEntry failed");
-                    return false;
-                }
             }
-            else{
-                // update device in use cache
-                device_in_use_ptr = (DeviceInUseInfo* )std::realloc(m_device_in_use_ptr, (m_device_in_use_size+1)*sizeof(DeviceInUseInfo));
-                m_device_in_use_ptr = nullptr;
 
-                if(device_in_use_ptr == NULL){
-                    loge("updateUserAccess - realloc failed errno: %d", errno);
-                    return false;
-                }
+            if(storeInUseSlot(slot.mac, slot) != FError::NO_ERROR){
+                loge("updateUserAccess - storeInUseSlot failed");
+                return false;
+            }
 
-                strcpy((device_in_use_ptr+m_device_in_use_size)->pmi, m_pmi.c_str());
-                strcpy((device_in_use_ptr+m_device_in_use_size)->ntid, m_ntid.c_str());
-                strcpy((device_in_use_ptr+m_device_in_use_size)->ip, m_available_devices[m_user_requested_index].ip);
-                strcpy((device_in_use_ptr+m_device_in_use_size)->mac, m_available_devices[m_user_requested_index].mac);
-                strcpy((device_in_use_ptr+m_device_in_use_size)->startTime, timeStamp);
-                (device_in_use_ptr+m_device_in_use_size)->processId = getpid();
-
-                if(serialize<DeviceInUseInfo>(m_device_in_use_filename, device_in_use_ptr, m_device_in_use_size+1) != FError::NO_ERROR){
-                    loge("updateUserAccess - serialize failed");
-                    free(device_in_use_ptr);
-                    device_in_use_ptr = nullptr;
-                    return false;
-                }
+            if(m_available_devices[m_user_requested_index].isBeingUsed && !updateEntry(entry)){
+                loge("updateUserAccess - updateEntry failed");
+                return false;
             }
         }
 
@@ -574,36 +1540,16 @@ class Device {
             }
 
             strcpy(entry.ntid, m_ntid.c_str());
-            strcpy(entry.pmi, m_user_devices[m_user_requested_index].pmi);
-            strcpy(entry.ip, m_user_devices[m_user_requested_index].ip);
-            strcpy(entry.mac, m_user_devices[m_user_requested_index].mac);
-            strcpy(entry.startTime, m_user_devices[m_user_requested_index].startTime);
-            strcpy(entry.endTime, timeStamp);
+            entry.pmiId = m_user_devices[m_user_requested_index].pmiId;
+            entry.ip = m_user_devices[m_user_requested_index].ip;
+            memcpy(entry.mac, m_user_devices[m_user_requested_index].mac, sizeof(entry.mac));
+            entry.startTime = m_user_devices[m_user_requested_index].startTime;
+            entry.endTime = now;
             strcpy(entry.logoutType, "NORMAL");
 
-            // remove this device info from m_device_in_use
-            device_in_use_ptr = (DeviceInUseInfo* )std::malloc((m_device_in_use_size-1)*sizeof(DeviceInUseInfo));
-            
-            if(device_in_use_ptr == NULL){
-                loge("updateUserAccess - malloc failed errno: %d", errno);
-                return false;
-            }
-
-            int  j = 0;
-            for(size_t i = 0; i < m_device_in_use_size; i++){
-                if(strcmp((m_device_in_use_ptr+i)->mac, m_user_devices[m_user_requested_index].mac) != 0){
-                    strcpy((device_in_use_ptr+i)->pmi, (m_device_in_use_ptr+j)->pmi);
-                    strcpy((device_in_use_ptr+i)->ip, (m_device_in_use_ptr+j)->ip);
-                    strcpy((device_in_use_ptr+i)->mac, (m_device_in_use_ptr+j)->mac);
-                    strcpy((device_in_use_ptr+i)->ntid, (m_device_in_use_ptr+j)->ntid);
-                    strcpy((device_in_use_ptr+i)->startTime, (m_device_in_use_ptr+j)->startTime);
-                    (device_in_use_ptr+i)->processId = (m_device_in_use_ptr+j)->processId;
-                    j++;
-                }
-            }
-
-            if(serialize<DeviceInUseInfo>(m_device_in_use_filename, device_in_use_ptr, m_device_in_use_size-1) != FError::NO_ERROR){
-                loge("updateUserAccess - serialize failed");
+            // free slot of this device in device in use table
+            if(storeInUseSlot(m_user_devices[m_user_requested_index].mac, slot) != FError::NO_ERROR){
+                loge("updateUserAccess - storeInUseSlot failed");
                 return false;
             }
 
@@ -612,64 +1558,217 @@ class Device {
                 return false;
             }
         }
-        
-        if(device_in_use_ptr)
-		    free(device_in_use_ptr);
         return true;
     }
 
     // scan for available devices, and update their information in device cache file 
+    // scan and pmi fetch are pipelined: each host that answers is handed to the pmi worker pool right away.
+    // In incremental mode hosts whose mac->ip mapping is unchanged keep their cached pmi without ssh, and cached
+    // devices that did not answer are kept while they were verified within m_cache_keep_s
     bool createDeviceCache(void){
-        logi("Enter createDeviceCache");
-        uint8_t device_count = 0;
-        size_t device_pmi_count = 0;
-        char pmi[16] = {'\0'};
-        ArpOut* scanned_devicesptr = nullptr;
-        DeviceInfo* cacheptr = nullptr;
-
-        // scan subnet for pingable devices
-        // device_count = gping.pingSubnetIp("10.0.0");
-        // device_count = gping.pingSubnetIp("192.168.0");
-        gping.pingSubnetIp("10.0.0");
-
-        scanned_devicesptr = new ArpOut[253];
-        
-        // get the scanned devices info from arp output
-        System::arp(scanned_devicesptr, device_count);
-        
+        logi("Enter createDeviceCache range: %s, incremental: %d", m_scan_range.c_str(), m_incremental_scan);
+        std::vector<struct in_addr> hosts;
+        std::vector<ArpOut> scanned_devices;
+        std::vector<DeviceInfo> cache;
+        std::map<std::string, DeviceInfo> previous; // cached devices keyed by mac
+        std::mutex cache_mutex;
+        size_t device_count = 0;
+        size_t reused_count = 0;
+        size_t skipped_count = 0;
+        time_t now = time(nullptr);
+        RttHistoryMap rtt_history;
+        NegativeCache negative;
+
+        loadNegativeCache(negative);
+        if(m_incremental_scan && isDeviceCacheFileExist()){
+            DeviceInfo* previous_ptr = nullptr;
+            size_t previous_size = 0;
+            if(deserialize<DeviceInfo>(m_device_cache_filename, &previous_ptr, previous_size) == FError::NO_ERROR && previous_ptr){
+                for(size_t i = 0; i < previous_size; i++)
+                    previous[AddrUtil::macToString((previous_ptr+i)->mac)] = *(previous_ptr+i);
+            }
+            unmap(previous_ptr, previous_size);
+            logi("createDeviceCache - previous cache entries: %ld", previous.size());
+        }
+
+        if(!Ping::parseRanges(m_scan_range, hosts)){
+            fprintf(stderr, " Invalid scan range: %s\n", m_scan_range.c_str());
+            return false;
+        }
+
+        PipelineProgressBar bar(" Scannig and fetching PMI...", "Scan", "PMI");
+        bar.start(hosts.size());
+        {
+            // attempt to get pmi info, m_pmi_workers probes in flight, each bounded by m_pmi_deadline_s
+            // every host goes through tcp probe of ssh port first, ssh is spawned only for hosts where sshd answers
+            WorkerPool pool(m_pmi_workers);
+            PortProbe ssh_probe(System::m_port, m_port_probe_timeout_ms, true);
+            if(!ssh_probe.isValid()){ // every host would look closed and get negative cached
+                bar.end();
+                fprintf(stderr, " Can not probe ssh port, cache left as is\n");
+                return false;
+            }
+            auto fetchPmi = [&](const ArpOut& host){
+                bar.secondAdd();
+                ssh_probe.submit(host.ip, [&, host](const PortProbeResult& port){ pool.submit([&, host, port]{
+                    DeviceInfo device;
+                    char mac[18];
+                    char pmi[256] = {'\0'};
+                    bool reused = false;
+                    device.pmiId = 0;
+                    device.ip = AddrUtil::parseIp(host.ip);
+                    strcpy(mac, host.mac);
+                    // icmp answers carry no mac, kernel has it resolved by now. Needed for reuse and negative cache
+                    // lookups, and always for a closed port so even a first scan records it as a failure
+                    if(mac[0] == '\0' && (!previous.empty() || !negative.empty() || !port.open))
+                        System::neighborMac(host.ip, mac);
+                    AddrUtil::parseMac(mac, device.mac);
+                    if(mac[0] != '\0' && negative.isBlocked(mac, now)){
+                        logd("createDeviceCache - %s at %s is negative cached, skipping", mac, host.ip);
+                        std::lock_guard<std::mutex> lock(cache_mutex);
+                        skipped_count++;
+                        bar.secondStep();
+                        return;
+                    }
+                    if(!previous.empty()){
+                        auto it = previous.find(mac);
+                        if(mac[0] != '\0' && it != previous.end() && it->second.ip == device.ip){
+                            logd("createDeviceCache - %s still at %s, reusing pmi id %u", mac, host.ip, it->second.pmiId);
+                            device.pmiId = it->second.pmiId;
+                            reused = true;
+                        }
+                    }
+                    if(!reused){
+                        // ssh device and extract pmi from build name, hosts without ssh (phones, laptops) go to negative cache.
+                        // A failed ssh on an open port (deadline, auth, unparsable version) only leaves device out of this scan
+                        if(port.open)
+                            System::getPmi(host.ip, pmi, sizeof(pmi), m_pmi_deadline_s);
+                        else
+                            logd("createDeviceCache - no sshd on %s:%d, skipping ssh", host.ip, System::m_port);
+                        if(pmi[0] != '\0')
+                            device.pmiId = internPmi(pmi);
+                        if(mac[0] != '\0'){
+                            if(!port.open)
+                                negative.recordFailure(mac, host.ip, now);
+                            else
+                                negative.recordSuccess(mac);
+                        }
+                    }
+                    if(device.pmiId != 0){
+                        device.lastVerified = now;
+                        std::lock_guard<std::mutex> lock(cache_mutex);
+                        cache.push_back(device);
+                        if(reused)
+                            reused_count++;
+                    }
+                    bar.secondStep();
+                }); });
+            };
+
+            if(m_scan_mode == ScanMode::ARP){
+                // arp replies carry ip and mac, no need of kernel neighbor table
+                if(!ArpScan::sweep(hosts, scanned_devices, [&](const ArpOut& host){ fetchPmi(host); return true; })){
+                    fprintf(stderr, " Arp scan failed, falling back to icmp scan\n");
+                    m_scan_mode = ScanMode::ICMP;
+                }
+                bar.firstComplete();
+            }
+
+            if(m_scan_mode == ScanMode::ICMP){
+                // scan subnet for pingable devices, mac is joined from neighbor table once pmi stage is done
+                // per host timeout/retries come from rtt history of previous scans
+                loadRttHistory(rtt_history);
+                gping.pingHosts(hosts, [&](const ProbeTarget& target){
+                    if(!target.late)
+                        bar.firstStep();
+                    if(target.state == ProbeTarget::ALIVE){
+                        ArpOut host;
+                        inet_ntop(AF_INET, &target.addr, host.ip, sizeof(host.ip));
+                        host.mac[0] = '\0';
+                        scanned_devices.push_back(host);
+                        fetchPmi(host);
+                    }
+                }, &rtt_history);
+            }
+            device_count = scanned_devices.size();
+            ssh_probe.wait();
+            pool.wait();
+        }
+	    bar.end();	
+        saveNegativeCache(negative);
+
+        std::map<std::string, std::string> ip_mac;
+        if(m_scan_mode == ScanMode::ICMP){
+            // get the scanned devices mac from kernel neighbor table
+            std::vector<ArpOut> neighbors;
+            struct in_addr addr;
+            System::arp(neighbors);
+            for(const ArpOut& neighbor : neighbors){
+                ip_mac[neighbor.ip] = neighbor.mac;
+                // a different device took over this ip, its old rtt stats do not apply
+                inet_pton(AF_INET, neighbor.ip, &addr);
+                auto it = rtt_history.find(addr.s_addr);
+                if(it != rtt_history.end() && strcmp(it->second.mac, neighbor.mac) != 0){
+                    if(it->second.mac[0] != '\0'){
+                        it->second.probes = it->second.answers = 1;
+                        it->second.loss = 0;
+                        it->second.rttvar_us = it->second.srtt_us/2;
+                    }
+                    strcpy(it->second.mac, neighbor.mac);
+                }
+            }
+            saveRttHistory(rtt_history);
+        }
+
         if(device_count == 0){
             logw("No devices found while scanning !!");
             return false;
         }
-	    fprintf(stderr, " Devices Found: %d\n", device_count);
-        cacheptr = new DeviceInfo[device_count];
-	    ProgressBar bar(" Fetching PMI...", device_count);
-	    bar.start();
-        // attempt to get pmi info
-        for(int i=0; i < device_count; i++){
-            // reset pmi
-            pmi[0] = '\0';
-            // ssh device and extract pmi from build name
-            System::getPmi((scanned_devicesptr+i)->ip, pmi); // **what if it fail ? say a mobile phone is conencted to a network
-            if(pmi[0] != '\0'){
-                strcpy((cacheptr+device_pmi_count)->pmi, pmi);
-                strcpy((cacheptr+device_pmi_count)->ip, (scanned_devicesptr+i)->ip);
-                strcpy((cacheptr+device_pmi_count)->mac, (scanned_devicesptr+i)->mac);
-                device_pmi_count++;
-            }
-	        bar.display();
+	    fprintf(stderr, " Devices Found: %ld\n", device_count);
+        if(reused_count > 0)
+            fprintf(stderr, " Devices unchanged since last scan: %ld\n", reused_count);
+        if(skipped_count > 0)
+            fprintf(stderr, " Hosts skipped, no ssh on earlier scans: %ld\n", skipped_count);
+
+        if(m_scan_mode == ScanMode::ICMP){
+            cache.erase(std::remove_if(cache.begin(), cache.end(), [&](DeviceInfo& device){
+                if(AddrUtil::isKnownMac(device.mac))
+                    return false;
+                std::string ip = AddrUtil::ipToString(device.ip);
+                auto it = ip_mac.find(ip);
+                if(it == ip_mac.end() || !AddrUtil::parseMac(it->second.c_str(), device.mac)){
+                    logw("createDeviceCache - mac not found for ip: %s, skipping", ip.c_str());
+                    return true;
+                }
+                return false;
+            }), cache.end());
         }
-	    bar.end();	
 
-        if(device_count > device_pmi_count){
-            logw("Valid devices from apr cmd - %d > Valid devices with pmi - %d", device_count, device_pmi_count);
+        if(device_count > cache.size()){
+            logw("Valid devices from scan - %d > Valid devices with pmi - %d", device_count, cache.size());
         }
 
-        // store the info into cache file
-        FError result = static_cast<FError>(serialize<DeviceInfo>(m_device_cache_filename, cacheptr, device_pmi_count));
+        // keep recently verified devices that did not answer this time (eg. in standby), unless their ip got taken
+        if(!previous.empty()){
+            std::map<std::string, bool> scanned_macs;
+            std::map<uint32_t, bool> scanned_ips;
+            for(const DeviceInfo& device : cache){
+                scanned_macs[AddrUtil::macToString(device.mac)] = true;
+                scanned_ips[device.ip] = true;
+            }
+            for(const auto& entry : previous){
+                const DeviceInfo& device = entry.second;
+                if(scanned_macs.count(entry.first) || scanned_ips.count(device.ip))
+                    continue;
+                if(now - device.lastVerified < m_cache_keep_s){
+                    logd("createDeviceCache - keeping silent device %s at %s", entry.first.c_str(), AddrUtil::ipToString(device.ip).c_str());
+                    cache.push_back(device);
+                }
+            }
+        }
 
-        delete[] scanned_devicesptr;
-        delete[] cacheptr;
+        // store the info into cache file
+        FError result = static_cast<FError>(serialize<DeviceInfo>(m_device_cache_filename, cache.data(), cache.size()));
 
         if( result != FError::NO_ERROR){
             loge("createDeviceCache - serialize failed - %d", result);
@@ -678,15 +1777,284 @@ class Device {
         return true;
     }
 
+    // targeted scan for the requested model only: hosts whose mac was cached with requested pmi are probed first,
+    // then hosts that answered recent sweeps (rtt history), then rest of the range. Stops as soon as a free device
+    // of the model is found or m_model_matches devices are found, and merges what it found into the device cache
+    bool scanForModel(void){
+        logi("Enter scanForModel pmi: %s, range: %s", m_pmi.c_str(), m_scan_range.c_str());
+        std::vector<struct in_addr> range_hosts;
+        std::map<std::string, DeviceInfo> previous; // cached devices keyed by mac
+        std::map<std::string, bool> busy_macs;
+        std::map<std::string, int> host_tier;       // ip -> 0 cached with pmi, 1 recently seen, 2 rest
+        std::vector<DeviceInfo> found;
+        std::mutex found_mutex;
+        size_t match_count = 0;
+        bool free_match = false;
+        time_t now = time(nullptr);
+        RttHistoryMap rtt_history;
+        NegativeCache negative;
+
+        if(m_pmi_id == 0 || !Ping::parseRanges(m_scan_range, range_hosts))
+            return false;
+        loadNegativeCache(negative);
+
+        if(isDeviceCacheFileExist()){
+            DeviceInfo* previous_ptr = nullptr;
+            size_t previous_size = 0;
+            if(deserialize<DeviceInfo>(m_device_cache_filename, &previous_ptr, previous_size) == FError::NO_ERROR && previous_ptr){
+                for(size_t i = 0; i < previous_size; i++)
+                    previous[AddrUtil::macToString((previous_ptr+i)->mac)] = *(previous_ptr+i);
+            }
+            unmap(previous_ptr, previous_size);
+        }
+        if(isDeviceInUseFileExist()){
+            DeviceInUseInfo* in_use_ptr = nullptr;
+            size_t in_use_size = 0;
+            if(loadInUseTable(&in_use_ptr, in_use_size) == FError::NO_ERROR && in_use_ptr){
+                for(size_t i = 0; i < in_use_size; i++){
+                    if((in_use_ptr+i)->startTime != 0)
+                        busy_macs[AddrUtil::macToString((in_use_ptr+i)->mac)] = true;
+                }
+            }
+            unmap(in_use_ptr, in_use_size);
+        }
+        loadRttHistory(rtt_history);
+
+        // tier 0 - macs cached with requested pmi, at their current ip if kernel knows it
+        std::vector<std::pair<std::string, std::string>> tier0; // ip, mac
+        std::vector<ArpOut> neighbors;
+        std::map<std::string, std::string> mac_ip;
+        System::arp(neighbors);
+        for(const ArpOut& neighbor : neighbors)
+            mac_ip[neighbor.mac] = neighbor.ip;
+        for(const auto& entry : previous){
+            if(entry.second.pmiId != m_pmi_id)
+                continue;
+            auto it = mac_ip.find(entry.first);
+            std::string ip = (it != mac_ip.end()) ? it->second : AddrUtil::ipToString(entry.second.ip);
+            if(host_tier.insert(std::make_pair(ip, 0)).second)
+                tier0.push_back(std::make_pair(ip, entry.first));
+        }
+
+        // tier 1 - recently answering hosts, most recent first
+        std::vector<const RttHistory*> recent;
+        for(const auto& entry : rtt_history){
+            if(entry.second.answers > 0)
+                recent.push_back(&entry.second);
+        }
+        std::sort(recent.begin(), recent.end(), [](const RttHistory* a, const RttHistory* b){ return a->last_seen > b->last_seen; });
+        for(const RttHistory* entry : recent)
+            host_tier.insert(std::make_pair(std::string(entry->ip), 1));
+
+        auto satisfied = [&]{
+            return free_match || match_count >= m_model_matches;
+        };
+        // ssh one host for pmi unless enough devices are already found
+        auto probe = [&](const std::string& ip, const std::string& mac, bool ssh_open){
+            {
+                std::lock_guard<std::mutex> lock(found_mutex);
+                if(satisfied())
+                    return;
+            }
+            DeviceInfo device;
+            char device_mac[18];
+            char pmi[256] = {'\0'};
+            strcpy(device_mac, mac.c_str());
+            if(device_mac[0] == '\0')
+                System::neighborMac(ip.c_str(), device_mac);
+            if(device_mac[0] != '\0' && negative.isBlocked(device_mac, now))
+                return;
+            if(!ssh_open){
+                if(device_mac[0] != '\0')
+                    negative.recordFailure(device_mac, ip.c_str(), now);
+                return;
+            }
+            // sshd answered, a failed pmi read only leaves host out of this scan
+            if(device_mac[0] != '\0')
+                negative.recordSuccess(device_mac);
+            System::getPmi(ip.c_str(), pmi, sizeof(pmi), m_pmi_deadline_s);
+            if(pmi[0] == '\0')
+                return;
+            // neighbor entry was still incomplete at the ping reply, the ssh session has resolved it since
+            if(device_mac[0] == '\0' && !System::neighborMac(ip.c_str(), device_mac)){
+                logw("scanForModel - no mac for %s, leaving it out of cache", ip.c_str());
+                return;
+            }
+            device.pmiId = internPmi(pmi);
+            if(device.pmiId == 0)
+                return;
+            device.ip = AddrUtil::parseIp(ip.c_str());
+            AddrUtil::parseMac(device_mac, device.mac);
+            device.lastVerified = now;
+
+            std::lock_guard<std::mutex> lock(found_mutex);
+            found.push_back(device);
+            if(device.pmiId == m_pmi_id){
+                match_count++;
+                if(!busy_macs.count(device_mac))
+                    free_match = true;
+                logi("scanForModel - match %s at %s, in use: %d", device_mac, ip.c_str(), busy_macs.count(device_mac) > 0);
+            }
+        };
+
+        fprintf(stderr, " Looking for %s/%s...\n", m_friendly_name.c_str(), m_pmi.c_str());
+        {
+            // ssh is spawned only for hosts whose sshd answered the tcp probe
+            WorkerPool pool(m_pmi_workers);
+            PortProbe ssh_probe(System::m_port, m_port_probe_timeout_ms, true);
+            if(!ssh_probe.isValid()){
+                fprintf(stderr, " Can not probe ssh port, cache left as is\n");
+                return false;
+            }
+            auto submit = [&](const std::string& ip, const std::string& mac){
+                ssh_probe.submit(ip.c_str(), [&, ip, mac](const PortProbeResult& port){
+                    pool.submit([&, ip, mac, port]{ probe(ip, mac, port.open); });
+                });
+            };
+            for(const auto& host : tier0)
+                submit(host.first, host.second);
+            ssh_probe.wait();
+            pool.wait();
+
+            if(!satisfied()){
+                // sweep rest of the range, recently seen hosts are probed as their replies arrive, the rest once
+                // the sweep is done so they do not take ssh workers ahead of a recently seen host answering late
+                std::vector<struct in_addr> hosts;
+                std::vector<std::string> alive;
+                for(struct in_addr host : range_hosts){
+                    char ip[INET_ADDRSTRLEN];
+                    inet_ntop(AF_INET, &host, ip, sizeof(ip));
+                    auto it = host_tier.find(ip);
+                    if(it == host_tier.end() || it->second != 0)
+                        hosts.push_back(host);
+                }
+                gping.pingHosts(hosts, [&](const ProbeTarget& target){
+                    if(target.state != ProbeTarget::ALIVE)
+                        return;
+                    char ip[INET_ADDRSTRLEN];
+                    inet_ntop(AF_INET, &target.addr, ip, sizeof(ip));
+                    if(host_tier.count(ip))
+                        submit(ip, "");
+                    else
+                        alive.push_back(ip);
+                }, &rtt_history);
+                saveRttHistory(rtt_history);
+
+                for(const std::string& ip : alive)
+                    submit(ip, "");
+                ssh_probe.wait();
+                pool.wait();
+            }
+        }
+
+        saveNegativeCache(negative);
+        fprintf(stderr, " Devices of %s found: %ld%s\n", m_friendly_name.c_str(), match_count, free_match ? "" : " (none free)");
+        if(match_count == 0)
+            return false;
+
+        // merge into cache, devices found here replace entries with same mac or ip
+        std::vector<DeviceInfo> cache;
+        for(const auto& entry : previous){
+            bool replaced = false;
+            for(const DeviceInfo& device : found){
+                if(!memcmp(device.mac, entry.second.mac, sizeof(device.mac)) || device.ip == entry.second.ip){
+                    replaced = true;
+                    break;
+                }
+            }
+            if(!replaced)
+                cache.push_back(entry.second);
+        }
+        cache.insert(cache.end(), found.begin(), found.end());
+
+        FError result = static_cast<FError>(serialize<DeviceInfo>(m_device_cache_filename, cache.data(), cache.size()));
+        if(result != FError::NO_ERROR){
+            loge("scanForModel - serialize failed - %d", result);
+            return false;
+        }
+        return true;
+    }
+
+    // fast path when requested device is not reachable at its cached ip, usually a dhcp lease moved it: find its
+    // cached mac in the live neighbor table, or with an arp sweep that stops at the first reply from that mac, then
+    // patch that single cache entry instead of rebuilding the whole cache
+    bool reResolveDeviceIp(void){
+        logi("Enter reResolveDeviceIp");
+        if(m_available_devices.empty() || m_user_requested_index >= m_available_devices.size())
+            return false;
+
+        ConnectionInfo& device = m_available_devices[m_user_requested_index];
+        std::string mac = AddrUtil::macToString(device.mac);
+        std::string ip = AddrUtil::ipToString(device.ip);
+        std::vector<ArpOut> neighbors;
+        std::string new_ip;
+
+        System::arp(neighbors);
+        for(const ArpOut& neighbor : neighbors){
+            if(mac == neighbor.mac && ip != neighbor.ip){
+                new_ip = neighbor.ip;
+                logi("reResolveDeviceIp - %s found in neighbor table at %s", mac.c_str(), neighbor.ip);
+                break;
+            }
+        }
+
+        if(new_ip.empty()){
+            std::vector<struct in_addr> hosts;
+            std::vector<ArpOut> found;
+            if(!Ping::parseRanges(m_scan_range, hosts))
+                return false;
+            ArpScan::sweep(hosts, found, [&](const ArpOut& host){
+                if(mac != host.mac)
+                    return true;
+                new_ip = host.ip;
+                return false;
+            });
+            if(!new_ip.empty())
+                logi("reResolveDeviceIp - %s answered arp at %s", mac.c_str(), new_ip.c_str());
+        }
+
+        if(new_ip.empty() || new_ip == ip){
+            logw("reResolveDeviceIp - no new ip found for %s", mac.c_str());
+            return false;
+        }
+        // same checks as speculative probe: sshd answers and device there still reports requested model.
+        // Master is kept for the session that follows
+        char banner[64];
+        char pmi[256] = {'\0'};
+        if(!PortProbe::isOpen(new_ip.c_str(), System::m_port, m_port_probe_timeout_ms, banner) || !System::getPmi(new_ip.c_str(), pmi, sizeof(pmi), m_pmi_deadline_s, true) || m_pmi != pmi){
+            logw("reResolveDeviceIp - %s at %s not reachable or reports pmi: %s", mac.c_str(), new_ip.c_str(), pmi);
+            return false;
+        }
+
+        // patch cache entry, it was loaded by loadNewConnectionDeviceInfo
+        const uint32_t MAC = TableIndex<DeviceInfo>::MAC;
+        for(size_t i = findRecord(m_device_cache_ptr, m_device_cache_size, MAC, keyHash(device.mac, 6)); i < m_device_cache_size; i = nextRecord(m_device_cache_ptr, m_device_cache_size, MAC, i)){
+            if(!memcmp((m_device_cache_ptr+i)->mac, device.mac, 6)){
+                (m_device_cache_ptr+i)->ip = AddrUtil::parseIp(new_ip.c_str());
+                (m_device_cache_ptr+i)->lastVerified = time(nullptr);
+                if(serialize<DeviceInfo>(m_device_cache_filename, m_device_cache_ptr, m_device_cache_size, m_device_cache_generation) != FError::NO_ERROR)
+                    loge("reResolveDeviceIp - serialize device cache failed");
+                break;
+            }
+        }
+        fprintf(stderr, " Device %s moved from %s to %s, cache updated\n", mac.c_str(), ip.c_str(), new_ip.c_str());
+        device.ip = AddrUtil::parseIp(new_ip.c_str());
+        return true;
+    }
+
     void changeDeviceCacheIp(size_t index, std::string newip, int port = 10022){
         logi("Enter changeDeviceCacheIp idnex: %d, newIp: %s, port: %d", index, newip.c_str(), port);
         if(m_device_cache_ptr){
             if(index < m_device_cache_size){
-                if(isDeviceReachable((m_device_cache_ptr + index)->ip, port)){
+                if(isDeviceReachable(AddrUtil::ipToString((m_device_cache_ptr + index)->ip), port)){
                     FError result = FError::NO_ERROR;
-                    strcpy((m_device_cache_ptr + index)->ip, newip.c_str());
-                    result = static_cast<FError>(serialize<DeviceInfo>(m_device_cache_filename, m_device_cache_ptr, m_device_cache_size));
-                    if(result != FError::NO_ERROR){
+                    (m_device_cache_ptr + index)->ip = AddrUtil::parseIp(newip.c_str());
+                    (m_device_cache_ptr + index)->lastVerified = time(nullptr);
+                    result = static_cast<FError>(serialize<DeviceInfo>(m_device_cache_filename, m_device_cache_ptr, m_device_cache_size, m_device_cache_generation));
+                    if(result == FError::STALE){
+                        fprintf(stderr, " Device cache was updated meanwhile, list it and try again\n");
+                    }
+                    else if(result != FError::NO_ERROR){
                         fprintf(stderr, " Oops some issue in serializing device cache\n");
                         loge("changeDeviceCacheIp - serialize device in use failed - %d", result);
                     }
@@ -704,6 +2072,204 @@ class Device {
         }
     }
 
+    // probe every available device in background: tcp probe of ssh port gives the rtt shown in the list, devices
+    // whose sshd answered then get a pmi read over ssh. No master is kept, only the session of the chosen device
+    // opens one
+    void startReachabilityProbe(void){
+        logi("Enter startReachabilityProbe devices: %ld", m_available_devices.size());
+        stopReachabilityProbe();
+        if(m_available_devices.empty())
+            return;
+        {
+            std::lock_guard<std::mutex> lock(m_reachability_mutex);
+            m_reachability.assign(m_available_devices.size(), Reachability{Reachability::PENDING, 0});
+            m_reachability_cancelled = false;
+        }
+        m_reachability_pool.reset(new WorkerPool(std::min(m_pmi_workers, m_available_devices.size())));
+        m_reachability_probe.reset(new PortProbe(System::m_port, m_port_probe_timeout_ms, true));
+        if(!m_reachability_probe->isValid()){ // list shows NA rather than every device unreachable
+            fprintf(stderr, " Can not probe ssh port, reachability unknown\n");
+            stopReachabilityProbe();
+            return;
+        }
+
+        for(size_t i = 0; i < m_available_devices.size(); i++){
+            std::string ip = AddrUtil::ipToString(m_available_devices[i].ip);
+            m_reachability_probe->submit(ip.c_str(), [this, i, ip](const PortProbeResult& port){
+                {
+                    std::lock_guard<std::mutex> lock(m_reachability_mutex);
+                    if(m_reachability_cancelled)
+                        return;
+                    m_reachability[i].rtt_us = port.connect_us;
+                    m_reachability[i].state = port.open ? Reachability::SSH_CHECK : Reachability::UNREACHABLE;
+                }
+                m_reachability_cv.notify_all();
+                if(!port.open)
+                    return;
+
+                m_reachability_pool->submit([this, i, ip]{
+                    char pmi[256] = {'\0'};
+                    {
+                        std::lock_guard<std::mutex> lock(m_reachability_mutex);
+                        if(m_reachability_cancelled)
+                            return;
+                    }
+                    // a different model answering on this ip means the device moved
+                    bool reachable = System::getPmi(ip.c_str(), pmi, sizeof(pmi), m_pmi_deadline_s) && m_pmi == pmi;
+                    {
+                        std::lock_guard<std::mutex> lock(m_reachability_mutex);
+                        if(m_reachability_cancelled)
+                            return;
+                        m_reachability[i].state = reachable ? Reachability::REACHABLE : Reachability::UNREACHABLE;
+                    }
+                    m_reachability_cv.notify_all();
+                });
+            });
+        }
+    }
+
+    // every device has a final result of speculative probe
+    bool isReachabilitySettled(void){
+        std::lock_guard<std::mutex> lock(m_reachability_mutex);
+        return std::none_of(m_reachability.begin(), m_reachability.end(), [](const Reachability& reach){
+            return reach.state == Reachability::PENDING || reach.state == Reachability::SSH_CHECK;
+        });
+    }
+
+    inline bool isReachabilityProbeRunning(void){
+        return m_reachability_probe != nullptr;
+    }
+
+    // give tcp probes up to wait_ms so the list shows rtt of devices that answer quickly,
+    // with settled waits for ssh checks as well
+    void waitReachabilityProbe(int wait_ms, bool settled = false){
+        std::unique_lock<std::mutex> lock(m_reachability_mutex);
+        m_reachability_cv.wait_for(lock, std::chrono::milliseconds(wait_ms), [this, settled]{
+            return std::none_of(m_reachability.begin(), m_reachability.end(), [settled](const Reachability& reach){
+                return reach.state == Reachability::PENDING || (settled && reach.state == Reachability::SSH_CHECK);
+            });
+        });
+    }
+
+    // upper bound of a full speculative probe of one device
+    inline int reachabilityProbeTimeoutMs(void){
+        return m_port_probe_timeout_ms + (m_pmi_deadline_s + 1)*1000;
+    }
+
+    // for the exec into chosen device's session: ssh of probes still running is terminated and probe and pool are
+    // left to the exec instead of waiting on pending tcp probes and pmi reads of other devices. Callbacks still
+    // running see the cancel and leave m_reachability alone
+    void cancelReachabilityProbe(void){
+        logi("Enter cancelReachabilityProbe");
+        {
+            std::lock_guard<std::mutex> lock(m_reachability_mutex);
+            m_reachability_cancelled = true;
+        }
+        ProcessRunner::getInstance().terminateAll();
+        m_reachability_probe.release();
+        m_reachability_pool.release();
+    }
+
+    void stopReachabilityProbe(void){
+        {
+            std::lock_guard<std::mutex> lock(m_reachability_mutex);
+            m_reachability_cancelled = true;
+        }
+        // probe first, its callbacks feed the pool
+        m_reachability_probe.reset();
+        m_reachability_pool.reset();
+        std::lock_guard<std::mutex> lock(m_reachability_mutex);
+        m_reachability.clear();
+    }
+
+    // serializes pick + in-use update of concurrent non-interactive allocations, -1 if lock file is unusable
+    int lockAllocation(void){
+        logi("Enter lockAllocation");
+        return lockFile(m_alloc_lock_filename);
+    }
+
+    void unlockAllocation(int fd){
+        unlockFile(fd);
+    }
+
+    // pick a device for non-interactive allocation: only free devices whose speculative probe succeeded,
+    // lower rtt first (RTT_BUCKET_US apart, closer is jitter), then least recently used by login record.
+    // reach is keyed by mac so it survives a reload of m_available_devices
+    bool selectAutoDevice(const std::map<std::string, Reachability>& reach, size_t& busy_count){
+        logi("Enter selectAutoDevice devices: %ld", m_available_devices.size());
+        const uint32_t RTT_BUCKET_US = 5000;
+        std::map<std::string, std::string> last_used; // mac -> latest end time, utc strings sort by time
+        std::vector<size_t> candidates;
+        busy_count = 0;
+
+        std::ifstream login_record(m_login_record_filename);
+        std::string line;
+        while(std::getline(login_record, line)){
+            // SNo,NTID,IP,MAC,StartTime(UTC),EndTime(UTC),LogOutType
+            std::vector<std::string> fields;
+            std::stringstream stream(line);
+            std::string field;
+            while(std::getline(stream, field, ','))
+                fields.push_back(field);
+            if(fields.size() >= 6 && last_used[fields[3]] < fields[5])
+                last_used[fields[3]] = fields[5];
+        }
+
+        for(size_t i = 0; i < m_available_devices.size(); i++){
+            if(m_available_devices[i].isBeingUsed){
+                busy_count++;
+                continue;
+            }
+            auto it = reach.find(AddrUtil::macToString(m_available_devices[i].mac));
+            if(it != reach.end() && it->second.state == Reachability::REACHABLE)
+                candidates.push_back(i);
+        }
+        if(candidates.empty())
+            return false;
+
+        std::sort(candidates.begin(), candidates.end(), [&](size_t a, size_t b){
+            std::string mac_a = AddrUtil::macToString(m_available_devices[a].mac);
+            std::string mac_b = AddrUtil::macToString(m_available_devices[b].mac);
+            uint32_t rtt_a = reach.at(mac_a).rtt_us/RTT_BUCKET_US;
+            uint32_t rtt_b = reach.at(mac_b).rtt_us/RTT_BUCKET_US;
+            if(rtt_a != rtt_b)
+                return rtt_a < rtt_b;
+            return last_used[mac_a] < last_used[mac_b];
+        });
+        setNewConnectionUserRequest(candidates.front());
+        logi("selectAutoDevice - picked %s at %s", AddrUtil::macToString(m_available_devices[candidates.front()].mac).c_str(), requestedDeviceIp().c_str());
+        return true;
+    }
+
+    std::map<std::string, Reachability> reachabilityByMac(void){
+        std::lock_guard<std::mutex> lock(m_reachability_mutex);
+        std::map<std::string, Reachability> reach;
+        for(size_t i = 0; i < m_reachability.size() && i < m_available_devices.size(); i++)
+            reach[AddrUtil::macToString(m_available_devices[i].mac)] = m_reachability[i];
+        return reach;
+    }
+
+    inline void setDetachedSession(bool detached){
+        logi("Enter setDetachedSession detached: %d", detached);
+        m_detached_session = detached;
+    }
+
+    inline std::string requestedDeviceIp(void){
+        return (m_user_requested_index < m_available_devices.size()) ? AddrUtil::ipToString(m_available_devices[m_user_requested_index].ip) : "";
+    }
+
+    // index of ntid's in-use device with given ip, loadUserDeviceInfo must be done
+    bool findUserDevice(const std::string& ip, size_t& index){
+        uint32_t addr = AddrUtil::parseIp(ip.c_str());
+        for(size_t i = 0; i < m_user_devices.size(); i++){
+            if(addr != 0 && addr == m_user_devices[i].ip){
+                index = i;
+                return true;
+            }
+        }
+        return false;
+    }
+
     void displayConnectionInfo(void){
         logi("Enter displayConnectionInfo");
         if(m_pmi.empty() || m_available_devices.empty()){
@@ -711,19 +2277,32 @@ class Device {
             return;
         }
             
-        char hyphens[81];
-        memset(hyphens, '-', 80);
-        hyphens[80] = '\0';
+        char hyphens[92];
+        memset(hyphens, '-', 91);
+        hyphens[91] = '\0';
 
         fprintf(stderr, "\n List of %s/%s Available:\n", m_friendly_name.c_str(), m_pmi.c_str());
         fprintf(stderr, " %s\n", hyphens); 
-        fprintf(stderr, " %-4s %-18s %-16s %-7s %-10s %-20s\n", "SNo", "MAC", "IP", "InUse", "NTID", "StartTime(UTC)");
+        fprintf(stderr, " %-4s %-18s %-16s %-7s %-10s %-20s %-10s\n", "SNo", "MAC", "IP", "InUse", "NTID", "StartTime(UTC)", "Reachable");
         fprintf(stderr, " %s\n", hyphens); 
 
+        std::lock_guard<std::mutex> lock(m_reachability_mutex);
         int count = 0;
         for(ConnectionInfo device : m_available_devices){
+            // "..." still probing, rtt with "?" while ssh check is pending
+            char reachable[16] = "NA";
+            if(m_reachability.size() == m_available_devices.size()){
+                const Reachability& reach = m_reachability[count];
+                if(reach.state == Reachability::PENDING)
+                    strcpy(reachable, "...");
+                else if(reach.state == Reachability::UNREACHABLE)
+                    strcpy(reachable, "No");
+                else
+                    snprintf(reachable, sizeof(reachable), "%.1fms%s", reach.rtt_us/1000.0, (reach.state == Reachability::SSH_CHECK) ? "?" : "");
+            }
             count++;
-            fprintf(stderr, " %-4s %-18s %-16s %-7s %-10s %-20s\n", std::to_string(count).c_str(), device.mac, device.ip, device.isBeingUsed ? "Yes" : "No", (device.ntid[0] == '\0') ? "NA" : device.ntid, (device.startTime[0] == '\0') ? "NA" : device.startTime);
+            fprintf(stderr, " %-4s %-18s %-16s %-7s %-10s %-20s %-10s\n", std::to_string(count).c_str(), AddrUtil::macToString(device.mac).c_str(), AddrUtil::ipToString(device.ip).c_str(), device.isBeingUsed ? "Yes" : "No"
+                , (device.ntid[0] == '\0') ? "NA" : device.ntid, (device.startTime == 0) ? "NA" : TimeUtil::toUTC(device.startTime).c_str(), reachable);
         }
         fprintf(stderr, " %s\n\n", hyphens); 
 
@@ -748,7 +2327,7 @@ class Device {
         int count = 0;
         for(UserDeviceInfo device : m_user_devices){
             count++;
-	    fprintf(stderr, " %-4s %-16s %-16s %-18s %-20s\n", std::to_string(count).c_str(), device.pmi, device.ip, device.mac, device.startTime);
+	    fprintf(stderr, " %-4s %-16s %-16s %-18s %-20s\n", std::to_string(count).c_str(), nameOf(device.pmiId), AddrUtil::ipToString(device.ip).c_str(), AddrUtil::macToString(device.mac).c_str(), TimeUtil::toUTC(device.startTime).c_str());
         }
         fprintf(stderr, " %s\n\n", hyphens); 
     }
@@ -758,7 +2337,7 @@ class Device {
         FError result = FError::NO_ERROR;
         // load device-cache-file 
         logi("Device cache file name: %s, homeDir: %s, prefixPath: %s", m_device_cache_filename, homeDir, prefixPath.c_str());
-        result = static_cast<FError>(deserialize<DeviceInfo>(m_device_cache_filename, &m_device_cache_ptr, m_device_cache_size));
+        result = static_cast<FError>(deserialize<DeviceInfo>(m_device_cache_filename, &m_device_cache_ptr, m_device_cache_size, &m_device_cache_generation));
         if(result != FError::NO_ERROR && result != FError::NO_FILE){
             loge("displayDeviceCache - deserialize device cache failed - %d", result);
         }
@@ -769,11 +2348,12 @@ class Device {
 
         fprintf(stderr, "\n Listing details of scanned devices:\n");
         fprintf(stderr, " %s\n", hyphens); 
-        fprintf(stderr, " %-4s %-18s %-16s %-10s\n", "SNo", "PMI", "IP", "MAC");
+        fprintf(stderr, " %-4s %-18s %-16s %-18s %-20s\n", "SNo", "PMI", "IP", "MAC", "Verified(UTC)");
         fprintf(stderr, " %s\n", hyphens); 
 
         for(size_t i = 0; i < m_device_cache_size; i++){
-            fprintf(stderr, " %-4s %-18s %-16s %-10s\n", std::to_string(i+1).c_str(), (m_device_cache_ptr+i)->pmi, (m_device_cache_ptr+i)->ip, (m_device_cache_ptr+i)->mac);
+            fprintf(stderr, " %-4s %-18s %-16s %-18s %-20s\n", std::to_string(i+1).c_str(), nameOf((m_device_cache_ptr+i)->pmiId), AddrUtil::ipToString((m_device_cache_ptr+i)->ip).c_str(), AddrUtil::macToString((m_device_cache_ptr+i)->mac).c_str()
+                , ((m_device_cache_ptr+i)->lastVerified == 0) ? "NA" : TimeUtil::toUTC((m_device_cache_ptr+i)->lastVerified).c_str());
         }
 
         fprintf(stderr, " %s\n", hyphens); 
@@ -783,7 +2363,7 @@ class Device {
         logi("Enter displayDeviceInUseCache");
         FError result = FError::NO_ERROR;
         // load device-in-use file
-        result = static_cast<FError>(deserialize<DeviceInUseInfo>(m_device_in_use_filename, &m_device_in_use_ptr, m_device_in_use_size));
+        result = static_cast<FError>(loadInUseTable(&m_device_in_use_ptr, m_device_in_use_size));
         if(result != FError::NO_ERROR && result != FError::NO_FILE){
             loge("displayDeviceInUseCache - deserialize device in use failed - %d", result);
         }
@@ -796,9 +2376,12 @@ class Device {
         fprintf(stderr, " %-4s %-18s %-16s %-18s %-11s %-21s %-8s\n", "SNo", "PMI", "IP", "MAC", "NTID", "StartTime(UTC)", "SSH-PID");
         fprintf(stderr, " %s\n", hyphens); 
 
-        for(size_t i = 0; i < m_device_in_use_size; i++){
-            fprintf(stderr, " %-4s %-18s %-16s %-18s %-11s %-21s %-8s\n", std::to_string(i+1).c_str(), (m_device_in_use_ptr+i)->pmi
-                , (m_device_in_use_ptr+i)->ip, (m_device_in_use_ptr+i)->mac, (m_device_in_use_ptr+i)->ntid, (m_device_in_use_ptr+i)->startTime
+        for(size_t i = 0, count = 0; i < m_device_in_use_size; i++){
+            if((m_device_in_use_ptr+i)->startTime == 0) // free slot
+                continue;
+            fprintf(stderr, " %-4s %-18s %-16s %-18s %-11s %-21s %-8s\n", std::to_string(++count).c_str(), nameOf((m_device_in_use_ptr+i)->pmiId)
+                , AddrUtil::ipToString((m_device_in_use_ptr+i)->ip).c_str(), AddrUtil::macToString((m_device_in_use_ptr+i)->mac).c_str(), (m_device_in_use_ptr+i)->ntid
+                , TimeUtil::toUTC((m_device_in_use_ptr+i)->startTime).c_str()
                 , std::to_string((m_device_in_use_ptr+i)->processId).c_str());
         }
 
@@ -810,31 +2393,39 @@ class Device {
         FError result = FError::NO_ERROR;
         std::vector<size_t> interested_device_indices;
 
+        // state machine comes back here after a rescan, drop what previous attempt loaded
+        m_available_devices.clear();
+        unmap(m_device_cache_ptr, m_device_cache_size);
+        unmap(m_device_in_use_ptr, m_device_in_use_size);
+
         // load device-cache-file 
-        result = static_cast<FError>(deserialize<DeviceInfo>(m_device_cache_filename, &m_device_cache_ptr, m_device_cache_size));
+        result = static_cast<FError>(deserialize<DeviceInfo>(m_device_cache_filename, &m_device_cache_ptr, m_device_cache_size, &m_device_cache_generation));
         if(result != FError::NO_ERROR){
             loge("loadNewConnectionDeviceInfo - deserialize device cache failed - %d", result);
             return false;
         }
 
         // load device-in-use file
-        result = static_cast<FError>(deserialize<DeviceInUseInfo>(m_device_in_use_filename, &m_device_in_use_ptr, m_device_in_use_size));
-        if(result != FError::NO_ERROR && result != FError::NO_FILE){
+        result = static_cast<FError>(loadInUseTable(&m_device_in_use_ptr, m_device_in_use_size));
+        if(result == FError::BAD_FORMAT){
+            // no in-use table of any schema, it is replaced on next connect
+            logw("loadNewConnectionDeviceInfo - device in use table of unknown format, treating devices as free");
+        }
+        else if(result != FError::NO_ERROR && result != FError::NO_FILE){
             loge("loadNewConnectionDeviceInfo - deserialize device in use failed - %d", result);
             return false;
         }
 
-        if(m_pmi.empty()){
+        if(m_pmi_id == 0){
             loge("loadNewConnectionDeviceInfo - requested device model's pmi info not found");
             return false;
         }
 
-        // filter requested pmi info from device cache
-        if(m_device_cache_ptr){
-            for(size_t i=0; i < m_device_cache_size; i++){
-                if(!std::strcmp((m_device_cache_ptr+i)->pmi, m_pmi.c_str())){
-                    interested_device_indices.push_back(i);
-                }
+        // filter requested pmi info from device cache, walks pmi chain of cache index
+        const uint32_t PMI = TableIndex<DeviceInfo>::PMI;
+        for(size_t i = findRecord(m_device_cache_ptr, m_device_cache_size, PMI, keyHash(&m_pmi_id, sizeof(m_pmi_id))); i < m_device_cache_size; i = nextRecord(m_device_cache_ptr, m_device_cache_size, PMI, i)){
+            if((m_device_cache_ptr+i)->pmiId == m_pmi_id){
+                interested_device_indices.push_back(i);
             }
         }
 
@@ -842,30 +2433,36 @@ class Device {
             logw("loadNewConnectionDeviceInfo - requested device model not found in device cache");
         }
 
+        // slot of every busy mac, built once instead of a scan of in-use table per device
+        std::unordered_map<uint64_t, size_t> busy_slots;
+        for(size_t j = 0; j < m_device_in_use_size; j++){
+            if((m_device_in_use_ptr+j)->startTime != 0)
+                busy_slots.emplace(macKey((m_device_in_use_ptr+j)->mac), j);
+        }
+
         // filter devices that are already in use
         for(int i : interested_device_indices){
             ConnectionInfo device;
 
             device.ntid[0] = '\0';
-            strcpy(device.ip, (m_device_cache_ptr+i)->ip);
-            strcpy(device.mac, (m_device_cache_ptr+i)->mac);
+            device.ip = (m_device_cache_ptr+i)->ip;
+            memcpy(device.mac, (m_device_cache_ptr+i)->mac, sizeof(device.mac));
 
-            device.startTime[0] = '\0';
+            device.startTime = 0;
             device.isBeingUsed = 0;
             device.processId = 0;
 
-            for(size_t j = 0; j < m_device_in_use_size; j++){
-                // find if any of the user requested models is already in use
-                if(!strcmp((m_device_in_use_ptr+j)->mac, (m_device_cache_ptr+i)->mac)){
-                    device.isBeingUsed = 1;
-                    // from when it being used
-                    strcpy(device.startTime, (m_device_in_use_ptr+j)->startTime);
-                    // who is using the device
-                    strcpy(device.ntid, (m_device_in_use_ptr+j)->ntid);
-                    // session id
-                    device.processId = (m_device_in_use_ptr+j)->processId;
-                    break;
-                }
+            // find if any of the user requested models is already in use
+            auto busy = busy_slots.find(macKey(device.mac));
+            if(busy != busy_slots.end()){
+                size_t j = busy->second;
+                device.isBeingUsed = 1;
+                // from when it being used
+                device.startTime = (m_device_in_use_ptr+j)->startTime;
+                // who is using the device
+                strcpy(device.ntid, (m_device_in_use_ptr+j)->ntid);
+                // session id
+                device.processId = (m_device_in_use_ptr+j)->processId;
             }
             m_available_devices.push_back(device);
         }
@@ -882,7 +2479,7 @@ class Device {
         logi("Enter loadUserDeviceInfo");
         FError result = FError::NO_ERROR;
         // load device-in-use file
-        result = static_cast<FError>(deserialize<DeviceInUseInfo>(m_device_in_use_filename, &m_device_in_use_ptr, m_device_in_use_size));
+        result = static_cast<FError>(loadInUseTable(&m_device_in_use_ptr, m_device_in_use_size));
         if(result != FError::NO_ERROR){
             loge("loadUserDeviceInfo - deserialize device in use failed - %d", result);
             return false;
@@ -896,11 +2493,11 @@ class Device {
         for(size_t j = 0; j < m_device_in_use_size; j++){
             // filter user's currently in use devices
             UserDeviceInfo device;
-            if(!strcmp((m_device_in_use_ptr+j)->ntid, m_ntid.c_str())){
-		        strcpy(device.pmi, (m_device_in_use_ptr+j)->pmi);
-                strcpy(device.ip, (m_device_in_use_ptr+j)->ip);
-                strcpy(device.mac, (m_device_in_use_ptr+j)->mac);
-                strcpy(device.startTime, (m_device_in_use_ptr+j)->startTime);
+            if((m_device_in_use_ptr+j)->startTime != 0 && !strcmp((m_device_in_use_ptr+j)->ntid, m_ntid.c_str())){
+		        device.pmiId = (m_device_in_use_ptr+j)->pmiId;
+                device.ip = (m_device_in_use_ptr+j)->ip;
+                memcpy(device.mac, (m_device_in_use_ptr+j)->mac, sizeof(device.mac));
+                device.startTime = (m_device_in_use_ptr+j)->startTime;
                 m_user_devices.push_back(device);
             }
         }
@@ -79,8 +79,8 @@ class Logger {
     void log(LogLevel msg_log_level, const char* log_level_str, const char* filename, int line_number, const char* message, Args... args) {
         if(logLevel <= msg_log_level) {
 
+            std::lock_guard<std::mutex> lock(log_mutex); // TimeUtil returns a shared buffer, take it under lock
             const char* timestamp = TimeUtil::nowISOUTC();
-            std::lock_guard<std::mutex> lock(log_mutex);
             printf("\n %s ", timestamp);
             printf(" [%s][%s:%d] ",log_level_str, filename, line_number);
             printf(message, args...);
@@ -4,30 +4,135 @@
 #include <iostream>
 #include <cstring>
 #include <vector>
+#include <queue>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <cerrno>
 #include <sys/time.h>
+#include <sys/epoll.h>
 #include <unistd.h>
+#include <netinet/ip.h>            // ip header of received raw packets
 #include <netinet/ip_icmp.h>       // icmp packet header
 #include <sys/socket.h>            // socket functions
 #include <netinet/in.h>            // sockaddr_in and IP protocols
 #include <arpa/inet.h>             // inet_pton, inet_ntop...
+#include <poll.h>
+#include <ctime>
+#include <unordered_map>
+#include <net/if.h>
+#include <net/ethernet.h>          // ethernet header
+#include <netinet/if_ether.h>      // arp packet layout
+#include <netpacket/packet.h>      // sockaddr_ll
+#include <sys/eventfd.h>            // wakes port probe epoll loop
 #include "Logger.h"
 #include "Utils.h"
+#include "System.h"
+
+// per target state used by Ping::sweep
+struct ProbeTarget {
+    enum State : uint8_t {
+        PENDING = 0,    // not probed yet
+        WAITING,        // echo sent, waiting for reply
+        ALIVE,          // echo reply received
+        DEAD            // all tries timed out
+    };
+
+    struct in_addr addr;
+    State state;
+    uint8_t tries;      // echo requests sent so far
+    uint8_t max_try;
+    uint64_t deadline;  // monotonic us, reply expected before this
+    uint64_t sent_ns;   // realtime ns of last echo request, compared against kernel rx timestamp
+    uint32_t rtt_us;    // round trip time of the answered echo, valid when ALIVE
+    uint32_t timeout_us; // per try reply timeout, 0 means Ping default
+    bool late;          // resolved DEAD first, its reply came after last timeout and it was reported again as ALIVE
+
+    ProbeTarget(struct in_addr target_addr, uint8_t max_try_count = 2)
+        : addr(target_addr), state(PENDING), tries(0), max_try(max_try_count), deadline(0), sent_ns(0), rtt_us(0), timeout_us(0), late(false)
+    { }
+};
+
+// per ip probe statistics persisted across sweeps, used to derive per target timeout and retry count
+struct RttHistory {
+    const static uint32_t SCHEMA_VERSION = 1;
+    char ip[16];
+    char mac[18];       // last mac seen at this ip, stats are reset when it changes
+    float srtt_us;      // smoothed rtt (ewma)
+    float rttvar_us;    // smoothed rtt deviation
+    float loss;         // ewma of lost echo requests per sweep
+    uint32_t probes;    // sweeps that probed this ip
+    uint32_t answers;   // sweeps in which this ip answered
+    time_t last_seen;   // epoch seconds of last answer
+};
+
+typedef std::unordered_map<uint32_t, RttHistory> RttHistoryMap; // keyed by in_addr.s_addr
+
+// limits probe send rate so that router does not drop replies due to icmp rate limiting
+class TokenBucket {
+    private:
+    double m_rate;      // tokens per second, 0 means unlimited
+    double m_burst;     // bucket capacity
+    double m_tokens;
+    uint64_t m_last_us;
+
+    void refill(void){
+        uint64_t now = TimeUtil::monotonicUs();
+        m_tokens = std::min(m_burst, m_tokens + (now - m_last_us)*m_rate/1000000);
+        m_last_us = now;
+    }
+
+    public:
+    TokenBucket(double rate, double burst)
+        : m_rate(rate), m_burst(burst), m_tokens(burst), m_last_us(TimeUtil::monotonicUs())
+    { }
+
+    // returns number of tokens granted, can be less than wanted
+    size_t take(size_t wanted){
+        if(m_rate <= 0)
+            return wanted;
+        refill();
+        size_t granted = std::min(wanted, static_cast<size_t>(m_tokens));
+        m_tokens -= granted;
+        return granted;
+    }
+
+    void giveBack(size_t count){
+        if(m_rate > 0)
+            m_tokens = std::min(m_burst, m_tokens + count);
+    }
+
+    // time in ms till next token is available
+    int waitMs(void){
+        if(m_rate <= 0)
+            return 0;
+        refill();
+        return (m_tokens >= 1) ? 0 : static_cast<int>((1 - m_tokens)*1000/m_rate) + 1;
+    }
+};
 
 class Ping {
     // constants
     private:
     const static int PING_PKT_S = 64;
+    const static int SWEEP_BATCH = 64; // packets per sendmmsg/recvmmsg call
+    const static int REPLY_PKT_S = 192; // ip header(max 60) + echo reply, bigger foreign packets get truncated
+    const static int MIN_TIMEOUT_US = 20000; // bounds of history derived per target timeout
+    const static int MAX_TIMEOUT_US = 2000000;
     
     // member variables
     private:
     int _pingInterval; // in ms eg. 1000000 micro second = 1 second
     int _recvTimeOut; // in ms
+    int _sendRate; // probes per second, 0 means unlimited
+    uint32_t _templateSum; // unfolded 1s complement sum of _echoTemplate without id/sequence
 
     // helper struct
     struct ping_pkt {
         struct icmphdr hdr; // 8 bytes
         char msg[PING_PKT_S - sizeof(struct icmphdr)]; // 56 bytes
-    };
+    } _echoTemplate;
 
     // member functions
     private:
@@ -49,6 +154,40 @@ class Ping {
         return result;
     }
 
+    // payload never changes, so build it and sum it once; only id/sequence are patched per probe
+    void buildEchoTemplate(void){
+        std::memset(&_echoTemplate, 0, sizeof(_echoTemplate));
+        // Construct ICMP packet
+        // fill ASCII for message
+        for (size_t i = 0; i < sizeof(_echoTemplate.msg) - 1; i++)
+            _echoTemplate.msg[i] = i + '0';
+        // terminate last msg byte with null
+        _echoTemplate.msg[sizeof(_echoTemplate.msg) - 1] = 0;
+        _echoTemplate.hdr.type = ICMP_ECHO;
+
+        unsigned short* buf = (unsigned short*)&_echoTemplate;
+        _templateSum = 0;
+        for (size_t i = 0; i < sizeof(_echoTemplate)/2; i++)
+            _templateSum += buf[i];
+    }
+
+    void fillEchoRequest(struct ping_pkt& pckt, uint16_t id, uint16_t sequence){
+        std::memcpy(&pckt, &_echoTemplate, sizeof(pckt));
+        pckt.hdr.un.echo.id = id;
+        pckt.hdr.un.echo.sequence = sequence;
+        uint32_t sum = _templateSum + id + sequence;
+        // carry wrap-around, same as checksum()
+        sum = (sum >> 16) + (sum & 0xFFFF);
+        sum += (sum >> 16);
+        pckt.hdr.checksum = ~sum;
+    }
+
+    static uint64_t realtimeNs(void){
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts); // same clock as SO_TIMESTAMPNS
+        return static_cast<uint64_t>(ts.tv_sec)*1000000000 + ts.tv_nsec;
+    }
+
     public:
     bool isIPV4Valid(const std::string& ); // TODO
     bool pingIp(const std::string& ping_ip, int max_try = 2, int add_recv_wait_ms = 0, int add_ping_gap_s = 0){
@@ -74,18 +213,7 @@ class Ping {
                 setsockopt(ping_sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv_out, sizeof(tv_out));
 
                 for (auto ping_loop = max_try; ping_loop > 0; ping_loop--) {
-                    std::memset(&pckt, 0, sizeof(pckt));
-                    
-                    // Construct ICMP packet
-                    // fill ASCII for message
-                    for (size_t i = 0; i < sizeof(pckt.msg) - 1; i++)
-                        pckt.msg[i] = i + '0';
-                    // terminate last msg byte with null
-                    pckt.msg[sizeof(pckt.msg) - 1] = 0;
-                    pckt.hdr.type = ICMP_ECHO;
-                    pckt.hdr.un.echo.id = getpid();
-                    pckt.hdr.un.echo.sequence = msg_count++;
-                    pckt.hdr.checksum = checksum(&pckt, sizeof(pckt));
+                    fillEchoRequest(pckt, getpid(), msg_count++);
                     usleep(_pingInterval + add_ping_gap_s);
 
                     struct sockaddr_in ping_addr; // address structure for IPV_4
@@ -122,31 +250,406 @@ class Ping {
         return (rval);
     }
 
-    uint8_t pingSubnetIp(const std::string& network_addr){
-        logi("Enter pingSubnetIp: %s", network_addr.c_str());
-        std::string subnetIp;
-        std::string newNetIp =  network_addr + ".";
-        uint8_t pingSuccedCount = 0;
-        ProgressBar bar(" Scannig...", 253);
-        bar.start();
-        for(int i = 2; i < 255; i++){
-            subnetIp = newNetIp + std::to_string(i);
-            logd("Pinging Ip: %s", subnetIp.c_str());
-            if(!pingIp(subnetIp))
-                logd(">>Ping Failed");
+    // Probe all targets from one raw socket: echo requests are sent in batches with sendmmsg and replies are drained
+    // with recvmmsg on epoll readiness, matched to targets by icmp id/sequence (sequence = target index). RTT is taken
+    // from the kernel receive timestamp (SO_TIMESTAMPNS). A target is retried on timeout until max_try.
+    // Returns count of alive targets, onDone is invoked once per target when it turns ALIVE or DEAD, and once more
+    // (late set) for a DEAD target whose reply still arrives during the sweep or within a timeout after it.
+    template<typename Callback>
+    size_t sweep(std::vector<ProbeTarget>& targets, Callback onDone){
+        logi("Enter sweep targets: %ld", targets.size());
+        size_t alive_count = 0;
+        size_t done_count = 0;
+        size_t next_pending = 0;
+        // min heap on deadline, entries of resolved targets are skipped when popped
+        typedef std::pair<uint64_t, size_t> Deadline;
+        std::priority_queue<Deadline, std::vector<Deadline>, std::greater<Deadline>> timeouts;
+        std::vector<size_t> resend;
+        TokenBucket bucket(_sendRate, SWEEP_BATCH);
+        uint16_t echo_id = getpid() & 0xFFFF;
+        int ttl_val = 64;
+        int enable = 1;
+        int rcvbuf = 1 << 20; // room for a burst of replies while the loop is busy sending
+        errno = 0;
+
+        if(targets.empty())
+            return 0;
+        if(targets.size() > 0x10000){
+            loge("sweep - too many targets: %ld, icmp sequence can address only 65536", targets.size());
+            return 0;
+        }
+
+        int sockfd = socket(AF_INET, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_ICMP);
+        if(sockfd < 0){
+            loge("Socket file descriptor not received try executing with sudo!! errno: %d", errno);
+            return 0;
+        }
+        if(setsockopt(sockfd, SOL_IP, IP_TTL, &ttl_val, sizeof(ttl_val)) != 0)
+            loge("Setting socket options to TTL failed!");
+        if(setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)) != 0)
+            logw("sweep - Setting SO_RCVBUF failed errno: %d", errno);
+        if(setsockopt(sockfd, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable)) != 0)
+            logw("sweep - SO_TIMESTAMPNS not supported, rtt will use user space receive time");
+
+        int epollfd = epoll_create1(EPOLL_CLOEXEC);
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = sockfd;
+        if(epollfd < 0 || epoll_ctl(epollfd, EPOLL_CTL_ADD, sockfd, &ev) != 0){
+            loge("sweep - epoll setup failed errno: %d", errno);
+            if(epollfd >= 0)
+                close(epollfd);
+            close(sockfd);
+            return 0;
+        }
+
+        // send side batch buffers
+        struct ping_pkt tx_pkts[SWEEP_BATCH];
+        struct sockaddr_in tx_addrs[SWEEP_BATCH];
+        struct iovec tx_iovs[SWEEP_BATCH];
+        struct mmsghdr tx_msgs[SWEEP_BATCH];
+        size_t tx_index[SWEEP_BATCH];
+        bool tx_is_resend[SWEEP_BATCH];
+
+        // receive side batch buffers
+        char rx_bufs[SWEEP_BATCH][REPLY_PKT_S];
+        char rx_ctrl[SWEEP_BATCH][CMSG_SPACE(sizeof(struct timespec))];
+        struct sockaddr_in rx_addrs[SWEEP_BATCH];
+        struct iovec rx_iovs[SWEEP_BATCH];
+        struct mmsghdr rx_msgs[SWEEP_BATCH];
+
+        auto resolve = [&](size_t index, ProbeTarget::State state){
+            if(targets[index].state == ProbeTarget::DEAD)
+                targets[index].late = true; // counted as done already
             else
-                ++pingSuccedCount;
-            bar.display();
+                ++done_count;
+            targets[index].state = state;
+            if(state == ProbeTarget::ALIVE)
+                ++alive_count;
+            onDone(targets[index]);
+        };
+
+        // sends retries first and then fresh targets, returns false when socket buffer is full or rate limit is hit
+        auto send_batch = [&]() -> bool {
+            int count = 0;
+            int limit = bucket.take(std::min(static_cast<size_t>(SWEEP_BATCH), resend.size() + targets.size() - next_pending));
+            if(limit == 0)
+                return false;
+            while(count < limit && !resend.empty()){
+                tx_index[count] = resend.back();
+                tx_is_resend[count++] = true;
+                resend.pop_back();
+            }
+            while(count < limit && next_pending < targets.size()){
+                if(targets[next_pending].max_try == 0){
+                    resolve(next_pending++, ProbeTarget::DEAD);
+                    continue;
+                }
+                tx_index[count] = next_pending++;
+                tx_is_resend[count++] = false;
+            }
+            bucket.giveBack(limit - count);
+            if(count == 0)
+                return true;
+
+            std::memset(tx_msgs, 0, sizeof(tx_msgs[0])*count);
+            for(int i = 0; i < count; i++){
+                fillEchoRequest(tx_pkts[i], echo_id, static_cast<uint16_t>(tx_index[i]));
+                std::memset(&tx_addrs[i], 0, sizeof(tx_addrs[i]));
+                tx_addrs[i].sin_family = AF_INET;
+                tx_addrs[i].sin_addr = targets[tx_index[i]].addr;
+                tx_iovs[i].iov_base = &tx_pkts[i];
+                tx_iovs[i].iov_len = sizeof(tx_pkts[i]);
+                tx_msgs[i].msg_hdr.msg_name = &tx_addrs[i];
+                tx_msgs[i].msg_hdr.msg_namelen = sizeof(tx_addrs[i]);
+                tx_msgs[i].msg_hdr.msg_iov = &tx_iovs[i];
+                tx_msgs[i].msg_hdr.msg_iovlen = 1;
+            }
+
+            uint64_t sent_ns = realtimeNs();
+            uint64_t sent_us = TimeUtil::monotonicUs();
+            int sent = sendmmsg(sockfd, tx_msgs, count, 0);
+            if(sent < 0){
+                if(errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS){
+                    // unreachable destination etc. fails only the first message, count it as sent so sweep moves on
+                    logd("sweep - sendmmsg to %s failed errno: %d", inet_ntoa(targets[tx_index[0]].addr), errno);
+                    sent = 1;
+                }
+                else{
+                    sent = 0;
+                }
+            }
+
+            for(int i = 0; i < count; i++){
+                size_t index = tx_index[i];
+                if(i < sent){
+                    targets[index].tries++;
+                    targets[index].state = ProbeTarget::WAITING;
+                    targets[index].sent_ns = sent_ns;
+                    targets[index].deadline = sent_us + (targets[index].timeout_us ? targets[index].timeout_us : _recvTimeOut);
+                    timeouts.push(std::make_pair(targets[index].deadline, index));
+                }
+                else if(tx_is_resend[i]){
+                    resend.push_back(index);
+                }
+                else{
+                    --next_pending; // unsent fresh targets are a suffix of the batch
+                }
+            }
+            bucket.giveBack(count - sent);
+            return sent == count;
+        };
+
+        // drains socket, returns when socket has no more queued replies
+        auto receive_batch = [&](){
+            int received;
+            do{
+                for(int i = 0; i < SWEEP_BATCH; i++){
+                    rx_iovs[i].iov_base = rx_bufs[i];
+                    rx_iovs[i].iov_len = sizeof(rx_bufs[i]);
+                    std::memset(&rx_msgs[i], 0, sizeof(rx_msgs[i]));
+                    rx_msgs[i].msg_hdr.msg_name = &rx_addrs[i];
+                    rx_msgs[i].msg_hdr.msg_namelen = sizeof(rx_addrs[i]);
+                    rx_msgs[i].msg_hdr.msg_iov = &rx_iovs[i];
+                    rx_msgs[i].msg_hdr.msg_iovlen = 1;
+                    rx_msgs[i].msg_hdr.msg_control = rx_ctrl[i];
+                    rx_msgs[i].msg_hdr.msg_controllen = sizeof(rx_ctrl[i]);
+                }
+                received = recvmmsg(sockfd, rx_msgs, SWEEP_BATCH, MSG_DONTWAIT, nullptr);
+                uint64_t user_rx_ns = realtimeNs();
+
+                for(int i = 0; i < received; i++){
+                    size_t len = rx_msgs[i].msg_len;
+                    struct iphdr* ip_hdr = (struct iphdr*)rx_bufs[i];
+                    size_t ip_hdr_len = ip_hdr->ihl * 4;
+                    if(len < ip_hdr_len + sizeof(struct icmphdr))
+                        continue;
+                    struct icmphdr* icmp_hdr = (struct icmphdr*)(rx_bufs[i] + ip_hdr_len);
+                    if(icmp_hdr->type != ICMP_ECHOREPLY || icmp_hdr->un.echo.id != echo_id)
+                        continue;
+                    size_t index = icmp_hdr->un.echo.sequence;
+                    if(index >= targets.size() || targets[index].addr.s_addr != rx_addrs[i].sin_addr.s_addr)
+                        continue;
+                    // slow host answering after its last timeout is alive all the same, its rtt teaches history
+                    if(targets[index].state != ProbeTarget::WAITING && targets[index].state != ProbeTarget::DEAD)
+                        continue;
+
+                    uint64_t rx_ns = user_rx_ns;
+                    for(struct cmsghdr* cmsg = CMSG_FIRSTHDR(&rx_msgs[i].msg_hdr); cmsg; cmsg = CMSG_NXTHDR(&rx_msgs[i].msg_hdr, cmsg)){
+                        if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS){
+                            struct timespec ts;
+                            std::memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+                            rx_ns = static_cast<uint64_t>(ts.tv_sec)*1000000000 + ts.tv_nsec;
+                        }
+                    }
+                    targets[index].rtt_us = (rx_ns > targets[index].sent_ns) ? (rx_ns - targets[index].sent_ns)/1000 : 0;
+                    logd(">>Received bytes from (\"%s\") msg_seq=%ld rtt=%dus", inet_ntoa(rx_addrs[i].sin_addr), index, targets[index].rtt_us);
+                    resolve(index, ProbeTarget::ALIVE);
+                }
+            } while(received == SWEEP_BATCH);
+        };
+
+        while(done_count < targets.size()){
+            bool blocked = false;
+            while(!blocked && (!resend.empty() || next_pending < targets.size()))
+                blocked = !send_batch();
+
+            // wait till the earliest deadline, or till next token/socket space if sends are pending
+            int wait_ms = -1;
+            if(!timeouts.empty()){
+                uint64_t now = TimeUtil::monotonicUs();
+                wait_ms = (timeouts.top().first > now) ? static_cast<int>((timeouts.top().first - now + 999)/1000) : 0;
+            }
+            if(blocked){
+                int blocked_ms = std::max(1, bucket.waitMs());
+                wait_ms = (wait_ms < 0) ? blocked_ms : std::min(wait_ms, blocked_ms);
+            }
+            struct epoll_event events[1];
+            int nfds = epoll_wait(epollfd, events, 1, wait_ms);
+            if(nfds < 0 && errno != EINTR){
+                loge("sweep - epoll_wait failed errno: %d", errno);
+                break;
+            }
+            if(nfds > 0)
+                receive_batch();
+
+            // expire targets whose deadline passed
+            uint64_t now = TimeUtil::monotonicUs();
+            while(!timeouts.empty() && timeouts.top().first <= now){
+                size_t index = timeouts.top().second;
+                timeouts.pop();
+                if(targets[index].state != ProbeTarget::WAITING || targets[index].deadline > now)
+                    continue;
+                if(targets[index].tries < targets[index].max_try)
+                    resend.push_back(index);
+                else
+                    resolve(index, ProbeTarget::DEAD);
+            }
+        }
+
+        // replies of hosts that timed out on their last try may still be on the way
+        bool lingering = std::any_of(targets.begin(), targets.end(), [](const ProbeTarget& target){ return target.state == ProbeTarget::DEAD && target.tries > 0; });
+        for(uint64_t now = TimeUtil::monotonicUs(), linger_end = now + _recvTimeOut; lingering && now < linger_end; now = TimeUtil::monotonicUs()){
+            struct epoll_event events[1];
+            int nfds = epoll_wait(epollfd, events, 1, static_cast<int>((linger_end - now + 999)/1000));
+            if(nfds < 0 && errno != EINTR)
+                break;
+            if(nfds > 0)
+                receive_batch();
+        }
+
+        close(epollfd);
+        close(sockfd);
+        logi("sweep - alive: %ld of %ld", alive_count, targets.size());
+        return alive_count;
+    }
+
+    // parse comma separated list of "a.b.c.d/n", "a.b.c.d-e.f.g.h" or "a.b.c.d" into host addresses,
+    // network and broadcast address of a cidr block are skipped (except /31 and /32)
+    static bool parseRanges(const std::string& ranges, std::vector<struct in_addr>& hosts){
+        logi("Enter parseRanges: %s", ranges.c_str());
+        std::stringstream stream(ranges);
+        std::string range;
+        while(std::getline(stream, range, ',')){
+            range.erase(std::remove_if(range.begin(), range.end(), ::isspace), range.end());
+            if(range.empty())
+                continue;
+
+            struct in_addr addr;
+            uint32_t first, last;
+            size_t slash = range.find('/');
+            size_t dash = range.find('-');
+            if(slash != std::string::npos){
+                int prefix = -1;
+                try { prefix = std::stoi(range.substr(slash + 1)); } catch(...) { }
+                if(prefix < 0 || prefix > 32 || inet_pton(AF_INET, range.substr(0, slash).c_str(), &addr) != 1){
+                    loge("parseRanges - invalid cidr: %s", range.c_str());
+                    return false;
+                }
+                uint32_t mask = (prefix == 0) ? 0 : (0xFFFFFFFFu << (32 - prefix));
+                first = ntohl(addr.s_addr) & mask;
+                last = first | ~mask;
+                if(prefix < 31){
+                    first++;
+                    last--;
+                }
+            }
+            else if(dash != std::string::npos){
+                struct in_addr end_addr;
+                if(inet_pton(AF_INET, range.substr(0, dash).c_str(), &addr) != 1 || inet_pton(AF_INET, range.substr(dash + 1).c_str(), &end_addr) != 1){
+                    loge("parseRanges - invalid range: %s", range.c_str());
+                    return false;
+                }
+                first = ntohl(addr.s_addr);
+                last = ntohl(end_addr.s_addr);
+            }
+            else{
+                if(inet_pton(AF_INET, range.c_str(), &addr) != 1){
+                    loge("parseRanges - invalid ip: %s", range.c_str());
+                    return false;
+                }
+                first = last = ntohl(addr.s_addr);
+            }
+
+            if(first > last || static_cast<uint64_t>(last - first) + hosts.size() >= 0x10000){
+                loge("parseRanges - range %s is empty or makes more than 65536 targets", range.c_str());
+                return false;
+            }
+            for(uint64_t host = first; host <= last; host++){
+                addr.s_addr = htonl(static_cast<uint32_t>(host));
+                hosts.push_back(addr);
+            }
+        }
+        return !hosts.empty();
+    }
+
+    // derive timeout and tries of a target from its history: known live hosts get srtt + 4*rttvar and extra tries
+    // when lossy, addresses that never answered get a single try
+    void planProbe(ProbeTarget& target, const RttHistory& history){
+        if(history.answers == 0){
+            if(history.probes >= 2)
+                target.max_try = 1;
+            return;
         }
-        bar.end();
-        return pingSuccedCount;
+        float timeout = history.srtt_us + 4*history.rttvar_us;
+        target.timeout_us = static_cast<uint32_t>(std::min(std::max(timeout, static_cast<float>(MIN_TIMEOUT_US)), static_cast<float>(MAX_TIMEOUT_US)));
+        target.max_try = static_cast<uint8_t>(std::min(2 + static_cast<int>(history.loss*4 + 0.5), 5));
+    }
+
+    // fold sweep outcome of a target into its history, a late answer replaces the loss folded in when it was DEAD
+    static void recordProbe(RttHistory& history, const ProbeTarget& target){
+        if(target.tries == 0)
+            return;
+        float lost = static_cast<float>(target.state == ProbeTarget::ALIVE ? target.tries - 1 : target.tries)/target.tries;
+        if(target.late){
+            history.loss = (history.probes == 1) ? lost : history.loss + 0.25f*(lost - 1.0f);
+        }
+        else{
+            history.probes++;
+            history.loss = (history.probes == 1) ? lost : 0.75f*history.loss + 0.25f*lost;
+        }
+        if(target.state != ProbeTarget::ALIVE)
+            return;
+
+        float rtt = static_cast<float>(target.rtt_us);
+        if(history.answers == 0){
+            history.srtt_us = rtt;
+            history.rttvar_us = rtt/2;
+        }
+        else{
+            // same gains as tcp rto estimation (rfc 6298)
+            history.rttvar_us = 0.75f*history.rttvar_us + 0.25f*std::abs(history.srtt_us - rtt);
+            history.srtt_us = 0.875f*history.srtt_us + 0.125f*rtt;
+        }
+        history.answers++;
+        history.last_seen = time(nullptr);
+    }
+
+    // sweep hosts in random order, onDone is invoked as each host is resolved so callers can pipeline work on
+    // answering hosts while the sweep is still running. When history is given, each target is planned from it
+    // and updated with the outcome. Returns count of hosts that answered
+    template<typename Callback>
+    size_t pingHosts(std::vector<struct in_addr> hosts, Callback onDone, RttHistoryMap* history = nullptr){
+        logi("Enter pingHosts: %ld", hosts.size());
+        // random order spreads the probes over the range instead of hammering one part of it
+        std::shuffle(hosts.begin(), hosts.end(), std::mt19937(std::random_device()()));
+
+        std::vector<ProbeTarget> targets;
+        targets.reserve(hosts.size());
+        for(struct in_addr host : hosts){
+            targets.push_back(ProbeTarget(host));
+            if(history){
+                auto it = history->find(host.s_addr);
+                if(it != history->end())
+                    planProbe(targets.back(), it->second);
+            }
+        }
+
+        return sweep(targets, [&](const ProbeTarget& target){
+            if(history){
+                RttHistory& entry = (*history)[target.addr.s_addr];
+                if(entry.probes == 0){
+                    std::memset(&entry, 0, sizeof(entry));
+                    inet_ntop(AF_INET, &target.addr, entry.ip, sizeof(entry.ip));
+                }
+                recordProbe(entry, target);
+            }
+            onDone(target);
+        });
+    }
+
+    inline void setSendRate(int probes_per_sec){
+        _sendRate = probes_per_sec;
     }
 
     private: 
     Ping()
         : _pingInterval(0) // dont wait before next retry
         , _recvTimeOut(100000) // .10 seconds time out for recv socket call
-    { }
+        , _sendRate(500) // keeps a /22 sweep around 2 seconds without tripping router icmp rate limits
+    {
+        buildEchoTemplate();
+    }
 
     public: // create singleton instance
     static Ping& getInstance(){
@@ -155,6 +658,439 @@ class Ping {
     }
 };
 
+// Layer-2 sweep: broadcasts arp requests for every target on an AF_PACKET socket and collects the replies itself,
+// finds hosts that drop icmp (eg. boxes in standby) and does not depend on kernel arp cache timing
+class ArpScan {
+    private:
+    const static int ARP_WAIT_US = 200000; // wait for replies after last request of a round
+    const static int ARP_ROUNDS = 2;       // requests per silent target
+
+    struct arp_frame {
+        struct ether_header eth;
+        struct ether_arp arp;
+    } __attribute__((packed));
+
+    static void fillRequest(struct arp_frame& frame, const unsigned char* my_mac, struct in_addr my_ip, struct in_addr target){
+        std::memset(&frame, 0, sizeof(frame));
+        std::memset(frame.eth.ether_dhost, 0xFF, ETH_ALEN);
+        std::memcpy(frame.eth.ether_shost, my_mac, ETH_ALEN);
+        frame.eth.ether_type = htons(ETHERTYPE_ARP);
+        frame.arp.arp_hrd = htons(ARPHRD_ETHER);
+        frame.arp.arp_pro = htons(ETHERTYPE_IP);
+        frame.arp.arp_hln = ETH_ALEN;
+        frame.arp.arp_pln = 4;
+        frame.arp.arp_op = htons(ARPOP_REQUEST);
+        std::memcpy(frame.arp.arp_sha, my_mac, ETH_ALEN);
+        std::memcpy(frame.arp.arp_spa, &my_ip.s_addr, 4);
+        std::memcpy(frame.arp.arp_tpa, &target.s_addr, 4);
+    }
+
+    public:
+    ArpScan() = delete;
+
+    // returns false if socket setup fails, found holds one entry per answering host and onFound is invoked
+    // for each of them as the reply arrives, sweep stops early when onFound returns false
+    template<typename Callback>
+    static bool sweep(std::vector<struct in_addr> hosts, std::vector<ArpOut>& found, Callback onFound, const char* interface = "wlan0", int send_rate = 500){
+        logi("Enter ArpScan::sweep hosts: %ld, interface: %s", hosts.size(), interface);
+        std::unordered_map<uint32_t, bool> answered; // target ip -> reply seen
+        unsigned char my_mac[ETH_ALEN];
+        char my_ip_str[INET_ADDRSTRLEN];
+        struct in_addr my_ip;
+        bool stop = false;
+        errno = 0;
+
+        std::shuffle(hosts.begin(), hosts.end(), std::mt19937(std::random_device()()));
+        for(struct in_addr host : hosts)
+            answered[host.s_addr] = false;
+
+        unsigned int ifindex = if_nametoindex(interface);
+        if(ifindex == 0 || !System::get_my_mac(my_mac, interface) || !System::get_my_ip(my_ip_str, interface)){
+            loge("ArpScan::sweep - interface %s not usable errno: %d", interface, errno);
+            return false;
+        }
+        inet_pton(AF_INET, my_ip_str, &my_ip);
+
+        int sockfd = socket(AF_PACKET, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, htons(ETH_P_ARP));
+        if(sockfd < 0){
+            loge("ArpScan::sweep - packet socket not received try executing with sudo!! errno: %d", errno);
+            return false;
+        }
+        struct sockaddr_ll link_addr;
+        std::memset(&link_addr, 0, sizeof(link_addr));
+        link_addr.sll_family = AF_PACKET;
+        link_addr.sll_protocol = htons(ETH_P_ARP);
+        link_addr.sll_ifindex = ifindex;
+        link_addr.sll_halen = ETH_ALEN;
+        std::memset(link_addr.sll_addr, 0xFF, ETH_ALEN);
+        if(bind(sockfd, (struct sockaddr*)&link_addr, sizeof(link_addr)) != 0){
+            loge("ArpScan::sweep - bind to %s failed errno: %d", interface, errno);
+            close(sockfd);
+            return false;
+        }
+
+        auto receive = [&](int wait_ms){
+            struct pollfd pfd = { sockfd, POLLIN, 0 };
+            if(poll(&pfd, 1, wait_ms) <= 0)
+                return;
+            struct arp_frame frame;
+            ssize_t len;
+            while(!stop && (len = recv(sockfd, &frame, sizeof(frame), 0)) > 0){
+                if(static_cast<size_t>(len) < sizeof(frame) || ntohs(frame.arp.arp_op) != ARPOP_REPLY)
+                    continue;
+                uint32_t sender;
+                std::memcpy(&sender, frame.arp.arp_spa, 4);
+                auto it = answered.find(sender);
+                if(it == answered.end() || it->second)
+                    continue;
+                it->second = true;
+
+                ArpOut entry;
+                inet_ntop(AF_INET, frame.arp.arp_spa, entry.ip, sizeof(entry.ip));
+                const unsigned char* mac = frame.arp.arp_sha;
+                snprintf(entry.mac, sizeof(entry.mac), "%02x:%02x:%02x:%02x:%02x:%02x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+                logd(">>Arp reply from %s at %s", entry.ip, entry.mac);
+                found.push_back(entry);
+                stop = !onFound(found.back());
+            }
+        };
+
+        TokenBucket bucket(send_rate, 64);
+        struct arp_frame request;
+        for(int round = 0; round < ARP_ROUNDS && !stop; round++){
+            for(struct in_addr host : hosts){
+                if(stop)
+                    break;
+                if(answered[host.s_addr])
+                    continue;
+                while(bucket.take(1) == 0)
+                    receive(bucket.waitMs());
+                fillRequest(request, my_mac, my_ip, host);
+                while(sendto(sockfd, &request, sizeof(request), 0, (struct sockaddr*)&link_addr, sizeof(link_addr)) < 0){
+                    if(errno != EAGAIN && errno != ENOBUFS){
+                        logd("ArpScan::sweep - sendto failed errno: %d", errno);
+                        break;
+                    }
+                    receive(1); // tx queue full, give it a moment
+                }
+                receive(0);
+            }
+
+            // collect late replies of this round
+            uint64_t deadline = TimeUtil::monotonicUs() + ARP_WAIT_US;
+            uint64_t now;
+            while(!stop && (now = TimeUtil::monotonicUs()) < deadline && found.size() < hosts.size())
+                receive(static_cast<int>((deadline - now + 999)/1000));
+            if(found.size() == hosts.size())
+                break;
+        }
+
+        close(sockfd);
+        logi("ArpScan::sweep - hosts answered: %ld of %ld", found.size(), hosts.size());
+        return true;
+    }
+};
+
+struct PortProbeResult {
+    char ip[16];
+    bool open;           // connect succeeded (and banner started with "SSH-" when banner read is on)
+    uint32_t connect_us; // time to complete tcp handshake
+    char banner[64];     // first line sent by server, empty unless banner read is on
+};
+
+// Tcp reachability layer: runs non-blocking connect() to one port for many hosts under one epoll loop in a
+// background thread, so closed hosts fail in ms (RST) and filtered ones after timeout_ms, without spawning ssh.
+// onDone of every submitted host is invoked from probe thread, it must not block for long
+class PortProbe {
+    private:
+    const static int MAX_INFLIGHT = 128; // sockets in connect at a time
+    const static size_t BANNER_MAX = sizeof(((PortProbeResult*)0)->banner) - 1;
+
+    typedef std::function<void(const PortProbeResult&)> Callback;
+    struct Connection {
+        int fd;
+        bool connected;
+        size_t banner_len;
+        uint64_t start_us;
+        uint64_t deadline_us;
+        PortProbeResult result;
+        Callback onDone;
+    };
+
+    int m_port;
+    int m_timeout_ms;
+    bool m_read_banner;
+    int m_epfd;
+    int m_wakefd;
+    std::deque<std::pair<std::string, Callback>> m_pending;
+    std::unordered_map<int, Connection> m_inflight; // fd -> connection, touched only by probe thread
+    size_t m_outstanding;
+    bool m_stop;
+    bool m_failed;    // epoll setup or wait failed, hosts submitted from then on complete as closed right away
+    std::mutex m_mutex;
+    std::condition_variable m_idle_cv;
+    std::thread m_thread;
+
+    void finish(Connection& conn, bool open){
+        conn.result.open = open;
+        conn.result.banner[conn.banner_len] = '\0';
+        logd(">>PortProbe %s:%d %s in %d us banner: %s", conn.result.ip, m_port, open ? "open" : "closed", conn.result.connect_us, conn.result.banner);
+        int fd = conn.fd; // conn lives in the node erased below
+        epoll_ctl(m_epfd, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+        PortProbeResult result = conn.result;
+        Callback onDone = std::move(conn.onDone);
+        m_inflight.erase(fd);
+        complete(result, onDone);
+    }
+
+    void complete(const PortProbeResult& result, Callback& onDone){
+        onDone(result);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(--m_outstanding == 0)
+            m_idle_cv.notify_all();
+    }
+
+    void start(const std::string& ip, Callback& onDone){
+        Connection conn;
+        std::memset(&conn.result, 0, sizeof(conn.result));
+        strncpy(conn.result.ip, ip.c_str(), sizeof(conn.result.ip) - 1);
+        conn.connected = false;
+        conn.banner_len = 0;
+        conn.start_us = TimeUtil::monotonicUs();
+        conn.deadline_us = conn.start_us + static_cast<uint64_t>(m_timeout_ms)*1000;
+        conn.onDone = std::move(onDone);
+
+        struct sockaddr_in addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(m_port);
+        if(inet_pton(AF_INET, conn.result.ip, &addr.sin_addr) != 1 || (conn.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0){
+            loge("PortProbe - socket for %s failed errno: %d", conn.result.ip, errno);
+            complete(conn.result, conn.onDone);
+            return;
+        }
+        if(connect(conn.fd, (struct sockaddr*)&addr, sizeof(addr)) == 0 || errno == EINPROGRESS){
+            struct epoll_event ev;
+            ev.events = EPOLLOUT;
+            ev.data.fd = conn.fd;
+            if(epoll_ctl(m_epfd, EPOLL_CTL_ADD, conn.fd, &ev) == 0){
+                m_inflight[conn.fd] = std::move(conn);
+                return;
+            }
+            loge("PortProbe - epoll_ctl for %s failed errno: %d", conn.result.ip, errno);
+        }
+        // refused or unreachable right away
+        logd(">>PortProbe %s:%d failed at connect errno: %d", conn.result.ip, m_port, errno);
+        close(conn.fd);
+        complete(conn.result, conn.onDone);
+    }
+
+    void handle(Connection& conn){
+        if(!conn.connected){
+            int error = 0;
+            socklen_t len = sizeof(error);
+            if(getsockopt(conn.fd, SOL_SOCKET, SO_ERROR, &error, &len) != 0 || error != 0){
+                finish(conn, false);
+                return;
+            }
+            conn.connected = true;
+            conn.result.connect_us = static_cast<uint32_t>(TimeUtil::monotonicUs() - conn.start_us);
+            if(!m_read_banner){
+                finish(conn, true);
+                return;
+            }
+            struct epoll_event ev;
+            ev.events = EPOLLIN;
+            ev.data.fd = conn.fd;
+            epoll_ctl(m_epfd, EPOLL_CTL_MOD, conn.fd, &ev);
+            return;
+        }
+
+        // server speaks first in ssh, one line "SSH-2.0-..." is enough to know sshd is alive
+        ssize_t len = recv(conn.fd, conn.result.banner + conn.banner_len, BANNER_MAX - conn.banner_len, 0);
+        if(len < 0 && (errno == EAGAIN || errno == EINTR))
+            return;
+        if(len <= 0){
+            finish(conn, false);
+            return;
+        }
+        conn.banner_len += len;
+        conn.result.banner[conn.banner_len] = '\0';
+        char* eol = strpbrk(conn.result.banner, "\r\n");
+        if(eol || conn.banner_len == BANNER_MAX){
+            if(eol){
+                *eol = '\0';
+                conn.banner_len = eol - conn.result.banner;
+            }
+            finish(conn, strncmp(conn.result.banner, "SSH-", 4) == 0);
+        }
+    }
+
+    void run(void){
+        struct epoll_event events[64];
+        while(true){
+            std::deque<std::pair<std::string, Callback>> admit;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if(m_stop && m_pending.empty() && m_inflight.empty())
+                    break;
+                while(!m_pending.empty() && m_inflight.size() + admit.size() < MAX_INFLIGHT){
+                    admit.push_back(std::move(m_pending.front()));
+                    m_pending.pop_front();
+                }
+            }
+            for(auto& pending : admit)
+                start(pending.first, pending.second);
+
+            // sleep till nearest deadline, or till submit() wakes us when idle
+            int wait_ms = -1;
+            uint64_t now = TimeUtil::monotonicUs();
+            for(const auto& entry : m_inflight){
+                int remaining = (entry.second.deadline_us > now) ? static_cast<int>((entry.second.deadline_us - now + 999)/1000) : 0;
+                if(wait_ms < 0 || remaining < wait_ms)
+                    wait_ms = remaining;
+            }
+
+            int ready = epoll_wait(m_epfd, events, 64, wait_ms);
+            if(ready < 0 && errno != EINTR){
+                loge("PortProbe - epoll_wait failed errno: %d", errno);
+                break;
+            }
+            for(int i = 0; i < ready; i++){
+                if(events[i].data.fd == m_wakefd){
+                    uint64_t count;
+                    if(read(m_wakefd, &count, sizeof(count)) < 0)
+                        logd("PortProbe - wake read failed errno: %d", errno);
+                    continue;
+                }
+                auto it = m_inflight.find(events[i].data.fd);
+                if(it != m_inflight.end())
+                    handle(it->second);
+            }
+
+            now = TimeUtil::monotonicUs();
+            std::vector<int> expired;
+            for(const auto& entry : m_inflight){
+                if(entry.second.deadline_us <= now)
+                    expired.push_back(entry.first);
+            }
+            for(int fd : expired)
+                finish(m_inflight[fd], false); // filtered, or accepted but silent
+        }
+
+        failAll();
+    }
+
+    // probe thread gone or never started, fail whatever is left so wait() returns
+    void failAll(void){
+        std::deque<std::pair<std::string, Callback>> left;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_failed = true;
+            left.swap(m_pending);
+        }
+        std::vector<int> fds;
+        for(const auto& entry : m_inflight)
+            fds.push_back(entry.first);
+        for(int fd : fds)
+            finish(m_inflight[fd], false);
+        for(auto& pending : left)
+            fail(pending.first, pending.second);
+    }
+
+    void fail(const std::string& ip, Callback& onDone){
+        PortProbeResult result;
+        std::memset(&result, 0, sizeof(result));
+        strncpy(result.ip, ip.c_str(), sizeof(result.ip) - 1);
+        complete(result, onDone);
+    }
+
+    void wake(void){
+        uint64_t one = 1;
+        if(write(m_wakefd, &one, sizeof(one)) < 0)
+            logd("PortProbe - wake write failed errno: %d", errno);
+    }
+
+    public:
+    PortProbe(int port, int timeout_ms = 1500, bool read_banner = false)
+        : m_port(port), m_timeout_ms(timeout_ms), m_read_banner(read_banner), m_outstanding(0), m_stop(false), m_failed(false)
+    {
+        m_epfd = epoll_create1(EPOLL_CLOEXEC);
+        m_wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = m_wakefd;
+        if(m_epfd < 0 || m_wakefd < 0 || epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_wakefd, &ev) != 0){
+            loge("PortProbe - epoll setup failed errno: %d", errno);
+            m_failed = true;
+            return;
+        }
+        m_thread = std::thread(&PortProbe::run, this);
+    }
+
+    PortProbe(const PortProbe&) = delete;
+    PortProbe& operator=(const PortProbe&) = delete;
+
+    ~PortProbe(){
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        if(m_thread.joinable()){
+            wake();
+            m_thread.join();
+        }
+        if(m_wakefd >= 0)
+            close(m_wakefd);
+        if(m_epfd >= 0)
+            close(m_epfd);
+    }
+
+    // false when epoll could not be set up or failed later, every host then completes as closed
+    inline bool isValid(void){
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return !m_failed;
+    }
+
+    void submit(const char* ip, Callback onDone){
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_outstanding++;
+            if(!m_failed){
+                m_pending.push_back(std::make_pair(std::string(ip), std::move(onDone)));
+                onDone = nullptr;
+            }
+        }
+        if(onDone)
+            fail(ip, onDone);
+        else
+            wake();
+    }
+
+    // block till every submitted host got its onDone
+    void wait(void){
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_idle_cv.wait(lock, [this]{ return m_outstanding == 0; });
+    }
+
+    // single host check, banner (BANNER_MAX + 1 bytes) is filled when given and requires an ssh banner
+    static bool isOpen(const char* ip, int port, int timeout_ms = 1500, char* banner = nullptr){
+        logi("Enter PortProbe::isOpen ip: %s, port: %d, timeout: %d", ip, port, timeout_ms);
+        bool open = false;
+        PortProbe probe(port, timeout_ms, banner != nullptr);
+        if(!probe.isValid())
+            return false;
+        probe.submit(ip, [&](const PortProbeResult& result){
+            open = result.open;
+            if(banner)
+                strcpy(banner, result.banner);
+        });
+        probe.wait();
+        return open;
+    }
+};
+
 // access methods using gping eg. gping.pingIp(pingIp)
 Ping& gping = Ping::getInstance();
 #endif
@@ -9,6 +9,8 @@
 #include <csignal>
 #include <cstdlib>
 #include <unistd.h>
+#include <vector>
+#include <string>
 
 #include <sys/ioctl.h>
 #include <sys/socket.h>
@@ -16,6 +18,32 @@
 #include <netinet/in.h>
 #include <net/if.h>
 #include <arpa/inet.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/neighbour.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <dirent.h>
+#include <spawn.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+extern char** environ;
+
+// attributes of a neighbor message follow ndmsg, libc headers leave these to libnetlink
+#ifndef NDA_RTA
+#define NDA_RTA(r) ((struct rtattr*)(((char*)(r)) + NLMSG_ALIGN(sizeof(struct ndmsg))))
+#endif
+#ifndef NDA_PAYLOAD
+#define NDA_PAYLOAD(n) NLMSG_PAYLOAD(n, sizeof(struct ndmsg))
+#endif
 
 
 struct ArpOut {
@@ -23,11 +51,434 @@ struct ArpOut {
     char mac[18];
 };
 
+struct ProcessResult {
+    int exit_code;      // exit status, 128+signal when killed, 124 on deadline (same as timeout(1)), -1 spawn failure
+    bool timed_out;
+    std::string output; // stdout, capped at max_output bytes
+};
+
+struct SpawnOptions {
+    int deadline_ms = 0;        // 0 means no deadline
+    size_t max_output = 4096;   // cap of ProcessResult::output
+    bool merge_stderr = false;  // stderr into stdout pipe instead of /dev/null
+    std::string stdin_path;     // file fed to child stdin, /dev/null when empty
+    int stdout_fd = -1;         // caller owned (O_CLOEXEC) fd for child stdout, runner then neither reads nor collects it
+    // streams stdout chunks as they arrive instead of collecting them in ProcessResult::output, invoked from
+    // runner thread with runner locked so it must not spawn
+    std::function<void(const char*, size_t)> onOutput;
+};
+
+// Runs children with posix_spawnp and explicit argv (no /bin/sh), stdout on a non-blocking pipe and stdin/stderr
+// on /dev/null. One epoll loop in a background thread supervises all of them: collects output, reaps through
+// pidfd (waitpid polling on kernels without it) and enforces per child deadline with SIGTERM, SIGKILL 1s later.
+// onExit is invoked from runner thread
+class ProcessRunner {
+    private:
+    typedef std::function<void(const ProcessResult&)> Callback;
+    const static int KILL_GRACE_US = 1000000;
+    const static int POLL_TICK_MS = 50; // reap interval for children without pidfd
+
+    struct Child {
+        pid_t pid;
+        int pidfd;
+        int outfd;
+        size_t max_output;
+        std::function<void(const char*, size_t)> onOutput;
+        uint64_t deadline_us; // 0 means no deadline
+        uint64_t kill_at_us;
+        ProcessResult result;
+        Callback onExit;
+    };
+
+    int m_epfd;
+    int m_wakefd;
+    std::map<pid_t, Child> m_children;
+    bool m_stop;
+    std::mutex m_mutex;
+    std::thread m_thread;
+
+    static uint64_t key(pid_t pid, bool is_pidfd){
+        return (static_cast<uint64_t>(pid) << 1) | (is_pidfd ? 1 : 0);
+    }
+
+    void drain(Child& child){
+        char buffer[4096];
+        ssize_t len;
+        while(child.outfd >= 0 && (len = read(child.outfd, buffer, sizeof(buffer))) != 0){
+            if(len < 0){
+                if(errno == EINTR)
+                    continue;
+                if(errno == EAGAIN)
+                    return;
+                break;
+            }
+            if(child.onOutput){
+                child.onOutput(buffer, len);
+                continue;
+            }
+            size_t room = child.max_output - std::min(child.max_output, child.result.output.size());
+            child.result.output.append(buffer, std::min(room, static_cast<size_t>(len)));
+        }
+        // eof or error, a grandchild holding the pipe (eg. persisted ssh master) must not keep us waiting
+        if(child.outfd >= 0){
+            epoll_ctl(m_epfd, EPOLL_CTL_DEL, child.outfd, nullptr);
+            close(child.outfd);
+            child.outfd = -1;
+        }
+    }
+
+    // called with m_mutex held, returns the finished child so callback runs unlocked
+    void reap(Child& child, int status, std::vector<Child>& finished){
+        drain(child);
+        if(child.outfd >= 0){
+            epoll_ctl(m_epfd, EPOLL_CTL_DEL, child.outfd, nullptr);
+            close(child.outfd);
+        }
+        if(child.pidfd >= 0){
+            epoll_ctl(m_epfd, EPOLL_CTL_DEL, child.pidfd, nullptr);
+            close(child.pidfd);
+        }
+        if(child.result.timed_out)
+            child.result.exit_code = 124;
+        else if(WIFEXITED(status))
+            child.result.exit_code = WEXITSTATUS(status);
+        else if(WIFSIGNALED(status))
+            child.result.exit_code = 128 + WTERMSIG(status);
+        logd(">>ProcessRunner pid %d exited with %d, output: %ld bytes", child.pid, child.result.exit_code, child.result.output.size());
+        finished.push_back(std::move(child));
+        m_children.erase(finished.back().pid);
+    }
+
+    void loop(void){
+        struct epoll_event events[64];
+        while(true){
+            std::vector<Child> finished;
+            int wait_ms = -1;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if(m_stop)
+                    break;
+                uint64_t now = TimeUtil::monotonicUs();
+                for(auto& entry : m_children){
+                    uint64_t next = entry.second.result.timed_out ? entry.second.kill_at_us : entry.second.deadline_us;
+                    int remaining = (next == 0) ? -1 : (next > now) ? static_cast<int>((next - now + 999)/1000) : 0;
+                    if(entry.second.pidfd < 0 && (remaining < 0 || remaining > POLL_TICK_MS))
+                        remaining = POLL_TICK_MS;
+                    if(remaining >= 0 && (wait_ms < 0 || remaining < wait_ms))
+                        wait_ms = remaining;
+                }
+            }
+
+            int ready = epoll_wait(m_epfd, events, 64, wait_ms);
+            if(ready < 0 && errno != EINTR){
+                loge("ProcessRunner - epoll_wait failed errno: %d", errno);
+                ready = 0;
+                usleep(POLL_TICK_MS*1000);
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                for(int i = 0; i < ready; i++){
+                    if(events[i].data.u64 == static_cast<uint64_t>(-1)){
+                        uint64_t count;
+                        if(read(m_wakefd, &count, sizeof(count)) < 0)
+                            logd("ProcessRunner - wake read failed errno: %d", errno);
+                        continue;
+                    }
+                    pid_t pid = static_cast<pid_t>(events[i].data.u64 >> 1);
+                    auto it = m_children.find(pid);
+                    if(it == m_children.end())
+                        continue;
+                    if(events[i].data.u64 & 1){
+                        int status = 0;
+                        if(waitpid(pid, &status, WNOHANG) == pid)
+                            reap(it->second, status, finished);
+                    }
+                    else{
+                        drain(it->second);
+                    }
+                }
+
+                uint64_t now = TimeUtil::monotonicUs();
+                std::vector<pid_t> pids;
+                for(auto& entry : m_children)
+                    pids.push_back(entry.first);
+                for(pid_t pid : pids){
+                    Child& child = m_children[pid];
+                    int status = 0;
+                    if(child.pidfd < 0 && waitpid(pid, &status, WNOHANG) == pid){
+                        reap(child, status, finished);
+                        continue;
+                    }
+                    if(child.deadline_us != 0 && !child.result.timed_out && now >= child.deadline_us){
+                        logw("ProcessRunner - pid %d hit deadline, terminating", pid);
+                        kill(pid, SIGTERM);
+                        child.result.timed_out = true;
+                        child.kill_at_us = now + KILL_GRACE_US;
+                    }
+                    else if(child.result.timed_out && child.kill_at_us != 0 && now >= child.kill_at_us){
+                        kill(pid, SIGKILL);
+                        child.kill_at_us = 0;
+                    }
+                }
+            }
+
+            for(Child& child : finished)
+                child.onExit(child.result);
+        }
+    }
+
+    ProcessRunner()
+        : m_stop(false)
+    {
+        m_epfd = epoll_create1(EPOLL_CLOEXEC);
+        m_wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u64 = static_cast<uint64_t>(-1);
+        if(m_epfd < 0 || m_wakefd < 0 || epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_wakefd, &ev) != 0)
+            loge("ProcessRunner - epoll setup failed errno: %d", errno);
+        m_thread = std::thread(&ProcessRunner::loop, this);
+    }
+
+    public:
+    ProcessRunner(const ProcessRunner&) = delete;
+    ProcessRunner& operator=(const ProcessRunner&) = delete;
+
+    ~ProcessRunner(){
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+            for(auto& entry : m_children){
+                kill(entry.first, SIGKILL);
+                waitpid(entry.first, nullptr, 0);
+            }
+        }
+        uint64_t one = 1;
+        if(write(m_wakefd, &one, sizeof(one)) < 0){ }
+        m_thread.join();
+        close(m_wakefd);
+        close(m_epfd);
+    }
+
+    static ProcessRunner& getInstance(){
+        static ProcessRunner runner;
+        return runner;
+    }
+
+    bool spawn(const std::vector<std::string>& argv, int deadline_ms, Callback onExit, size_t max_output = 4096){
+        SpawnOptions options;
+        options.deadline_ms = deadline_ms;
+        options.max_output = max_output;
+        return spawn(argv, options, std::move(onExit));
+    }
+
+    // start argv[0] from PATH, false if it could not be spawned (onExit is not invoked then)
+    bool spawn(const std::vector<std::string>& argv, const SpawnOptions& options, Callback onExit){
+        logi("Enter ProcessRunner::spawn cmd: %s, deadline: %d ms", argv.empty() ? "" : argv[0].c_str(), options.deadline_ms);
+        if(argv.empty())
+            return false;
+        int fds[2] = {-1, options.stdout_fd};
+        if(options.stdout_fd < 0){
+            if(pipe2(fds, O_CLOEXEC) != 0){
+                loge("ProcessRunner::spawn - pipe failed errno: %d", errno);
+                return false;
+            }
+            fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+        }
+
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, options.stdin_path.empty() ? "/dev/null" : options.stdin_path.c_str(), O_RDONLY, 0);
+        posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+        if(options.merge_stderr)
+            posix_spawn_file_actions_adddup2(&actions, fds[1], STDERR_FILENO);
+        else
+            posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+
+        std::vector<char*> args;
+        for(const std::string& arg : argv)
+            args.push_back(const_cast<char*>(arg.c_str()));
+        args.push_back(nullptr);
+
+        Child child;
+        int error;
+        {
+            // child must be registered before runner thread can see its pidfd
+            std::lock_guard<std::mutex> lock(m_mutex);
+            error = posix_spawnp(&child.pid, args[0], &actions, nullptr, args.data(), environ);
+            posix_spawn_file_actions_destroy(&actions);
+            if(options.stdout_fd < 0)
+                close(fds[1]);
+            if(error != 0){
+                loge("ProcessRunner::spawn - posix_spawnp %s failed error: %d", args[0], error);
+                if(fds[0] >= 0)
+                    close(fds[0]);
+                return false;
+            }
+
+#ifdef SYS_pidfd_open
+            child.pidfd = static_cast<int>(syscall(SYS_pidfd_open, child.pid, 0));
+#else
+            child.pidfd = -1;
+#endif
+            child.outfd = fds[0];
+            child.max_output = options.max_output;
+            child.onOutput = options.onOutput;
+            child.deadline_us = (options.deadline_ms > 0) ? TimeUtil::monotonicUs() + static_cast<uint64_t>(options.deadline_ms)*1000 : 0;
+            child.kill_at_us = 0;
+            child.result.exit_code = -1;
+            child.result.timed_out = false;
+            child.onExit = std::move(onExit);
+
+            struct epoll_event ev;
+            ev.events = EPOLLIN;
+            ev.data.u64 = key(child.pid, false);
+            if(child.outfd >= 0)
+                epoll_ctl(m_epfd, EPOLL_CTL_ADD, child.outfd, &ev);
+            if(child.pidfd >= 0){
+                ev.data.u64 = key(child.pid, true);
+                epoll_ctl(m_epfd, EPOLL_CTL_ADD, child.pidfd, &ev);
+            }
+            m_children[child.pid] = std::move(child);
+        }
+        uint64_t one = 1;
+        if(write(m_wakefd, &one, sizeof(one)) < 0)
+            logd("ProcessRunner::spawn - wake write failed errno: %d", errno);
+        return true;
+    }
+
+    // every running child is treated as if its deadline passed: SIGTERM now, SIGKILL after grace
+    void terminateAll(void){
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            uint64_t now = TimeUtil::monotonicUs();
+            for(auto& entry : m_children){
+                if(entry.second.result.timed_out)
+                    continue;
+                kill(entry.first, SIGTERM);
+                entry.second.result.timed_out = true;
+                entry.second.kill_at_us = now + KILL_GRACE_US;
+            }
+        }
+        uint64_t one = 1;
+        if(write(m_wakefd, &one, sizeof(one)) < 0)
+            logd("ProcessRunner::terminateAll - wake write failed errno: %d", errno);
+    }
+
+    int run(const std::vector<std::string>& argv, int deadline_ms, std::string& output, size_t max_output = 4096){
+        SpawnOptions options;
+        options.deadline_ms = deadline_ms;
+        options.max_output = max_output;
+        return run(argv, options, output);
+    }
+
+    // blocking form of spawn, returns exit code (see ProcessResult)
+    int run(const std::vector<std::string>& argv, const SpawnOptions& options, std::string& output){
+        std::mutex done_mutex;
+        std::condition_variable done_cv;
+        bool done = false;
+        ProcessResult result;
+        if(!spawn(argv, options, [&](const ProcessResult& exited){
+            std::lock_guard<std::mutex> lock(done_mutex);
+            result = exited;
+            done = true;
+            done_cv.notify_one();
+        }))
+            return -1;
+        std::unique_lock<std::mutex> lock(done_mutex);
+        done_cv.wait(lock, [&]{ return done; });
+        output = std::move(result.output);
+        return result.exit_code;
+    }
+};
+
 class System {
     public:
         static int m_port;
+        static int m_control_persist_s; // idle lifetime of a shared ssh master, 0 disables multiplexing
 
     private:
+    // private runtime dir holding one ControlMaster socket per device ($XDG_RUNTIME_DIR/cssh or /tmp/cssh-<uid>),
+    // empty when it can not be made safe, ssh then runs without multiplexing
+    static const std::string& controlDir(void){
+        static std::string dir;
+        static bool initialized = false;
+        if(initialized)
+            return dir;
+        initialized = true;
+        if(m_control_persist_s <= 0)
+            return dir;
+
+        const char* runtime = getenv("XDG_RUNTIME_DIR");
+        std::string path = (runtime && runtime[0] == '/') ? std::string(runtime) + "/cssh" : "/tmp/cssh-" + std::to_string(getuid());
+        struct stat st;
+        errno = 0;
+        if(mkdir(path.c_str(), 0700) != 0 && errno != EEXIST){
+            loge("controlDir - mkdir %s failed errno: %d", path.c_str(), errno);
+            return dir;
+        }
+        // someone else may have planted it in /tmp, master sockets give shell access so refuse anything not ours
+        if(lstat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode) || st.st_uid != getuid() || (st.st_mode & 0077)){
+            loge("controlDir - %s is not a private directory, ssh multiplexing disabled", path.c_str());
+            return dir;
+        }
+        dir = path;
+        cleanStaleMasters(dir);
+        return dir;
+    }
+
+    // master gone (crash, reboot of device, persist expiry race) leaves its socket behind, ssh would then fail
+    // to become master on that path, so drop sockets nobody listens on
+    static void cleanStaleMasters(const std::string& dir){
+        logi("Enter cleanStaleMasters dir: %s", dir.c_str());
+        DIR* dirp = opendir(dir.c_str());
+        if(!dirp)
+            return;
+        struct dirent* entry;
+        while((entry = readdir(dirp)) != nullptr){
+            std::string path = dir + "/" + entry->d_name;
+            struct stat st;
+            if(lstat(path.c_str(), &st) != 0 || !S_ISSOCK(st.st_mode))
+                continue;
+            struct sockaddr_un addr;
+            std::memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            if(path.size() >= sizeof(addr.sun_path))
+                continue;
+            strcpy(addr.sun_path, path.c_str());
+            int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if(sock < 0)
+                break;
+            if(connect(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0 && errno == ECONNREFUSED){
+                logd("cleanStaleMasters - removing stale master %s", path.c_str());
+                unlink(path.c_str());
+            }
+            close(sock);
+        }
+        closedir(dirp);
+    }
+
+    public:
+    // ssh options sharing one authenticated connection per device between reachability checks, pmi reads and
+    // the interactive session, empty when multiplexing is off. Without create_master an existing master is
+    // used but none is left behind, so a network scan does not park one ssh process per device
+    static std::vector<std::string> controlOptions(bool create_master = true){
+        std::vector<std::string> options;
+        const std::string& dir = controlDir();
+        if(dir.empty())
+            return options;
+        options.push_back("-o");
+        options.push_back(create_master ? "ControlMaster=auto" : "ControlMaster=no");
+        options.push_back("-o");
+        options.push_back("ControlPath=" + dir + "/%C"); // %C hash keeps path under sun_path limit
+        if(create_master){
+            options.push_back("-o");
+            options.push_back("ControlPersist=" + std::to_string(m_control_persist_s));
+        }
+        return options;
+    }
+
     static bool get_my_ip(char* ip_addr, const char* interface="wlan0"){ // usage: get_host_ip(ip-addr, "eth0")
         logi("Enter get_my_ip ip: %s, interface: %s", ip_addr, interface);
         int sock;
@@ -60,80 +511,200 @@ class System {
         return true;
     }
 
-    public:
-    static bool arp(ArpOut* cmdout, uint8_t &count){
-        logi("Enter arp");
+    static bool get_my_mac(unsigned char* mac_addr, const char* interface="wlan0"){ // mac_addr should hold 6 bytes
+        logi("Enter get_my_mac interface: %s", interface);
+        int sock;
+        struct ifreq ifr;
         errno = 0;
-        ArpOut* resarray = cmdout;
-        FILE *pipe; 
-        int status;
-        int exitcode;
-        char buffer[256];
-        char ip[16];
-        char mac[18];
 
-        pipe = popen("arp -a", "r");
-        if(pipe == NULL){
-            loge("popen failed for cmd \'arp\' errno: %d", errno);
+        if((sock = socket(AF_INET, SOCK_DGRAM, 0)) < 0){
+            loge("get_my_mac - Socket creation failed errno: %d", errno);
             return false;
         }
 
-        while(fgets(buffer, sizeof(buffer), pipe) != NULL){
-            sscanf(buffer, "? (%15[^)]) at %18s", ip, mac);
-            if(mac[0] != '<'){
-                ++count;
-                // logd("Valid mac: %s ip: %s", mac, ip);
-                std::strcpy(resarray->ip, ip);
-                std::strcpy(resarray->mac, mac);
-                resarray++;
-            }
+        std::memset(&ifr, 0, sizeof(ifr));
+        strncpy(ifr.ifr_name, interface, IFNAMSIZ - 1);
+        // use ioctl command SIOCGIFHWADDR - Socket IOCTL Get InterFace HardWare Address
+        if(ioctl(sock, SIOCGIFHWADDR, &ifr) < 0){
+            loge("get_my_mac - ioctl failed errno: %d", errno);
+            close(sock);
+            return false;
+        }
+
+        std::memcpy(mac_addr, ifr.ifr_hwaddr.sa_data, 6);
+        close(sock);
+        return true;
+    }
+
+    // dump kernel neighbor table (RTM_GETNEIGH) and collect ipv4 entries whose state is in nud_mask, of all links
+    // like arp -a unless an interface is given. An unknown interface falls back to all links
+    static bool arp(std::vector<ArpOut>& cmdout, const char* interface=nullptr, uint16_t nud_mask = NUD_REACHABLE | NUD_STALE | NUD_DELAY | NUD_PROBE | NUD_PERMANENT){
+        logi("Enter arp interface: %s, nud_mask: 0x%x", interface ? interface : "any", nud_mask);
+        errno = 0;
+        ArpOut entry;
+        unsigned int ifindex = 0;
+        char buffer[16384];
+        bool done = false;
+        bool rval = true;
+
+        if(interface && (ifindex = if_nametoindex(interface)) == 0)
+            logw("arp - unknown interface: %s errno: %d, reading all links", interface, errno);
+
+        int sock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+        if(sock < 0){
+            loge("arp - netlink socket creation failed errno: %d", errno);
+            return false;
         }
-        
-        status = pclose(pipe);
-        if(status == -1){
-            loge("pclose failed with errno: %d", errno);
+
+        struct {
+            struct nlmsghdr nlh;
+            struct ndmsg ndm;
+        } request;
+        std::memset(&request, 0, sizeof(request));
+        request.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(struct ndmsg));
+        request.nlh.nlmsg_type = RTM_GETNEIGH;
+        request.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+        request.nlh.nlmsg_seq = 1;
+        request.ndm.ndm_family = AF_INET;
+
+        struct sockaddr_nl kernel;
+        std::memset(&kernel, 0, sizeof(kernel));
+        kernel.nl_family = AF_NETLINK;
+        if(sendto(sock, &request, request.nlh.nlmsg_len, 0, (struct sockaddr*)&kernel, sizeof(kernel)) < 0){
+            loge("arp - RTM_GETNEIGH request failed errno: %d", errno);
+            close(sock);
             return false;
         }
- 
-        if(WIFEXITED(status)){
-            if((exitcode = WEXITSTATUS(status)) != 0){
-                loge("arp command failed with exit code: %d", exitcode);
-                return false;
+
+        while(!done){
+            ssize_t len = recv(sock, buffer, sizeof(buffer), 0);
+            if(len < 0){
+                if(errno == EINTR)
+                    continue;
+                loge("arp - netlink recv failed errno: %d", errno);
+                rval = false;
+                break;
+            }
+
+            for(struct nlmsghdr* nlh = (struct nlmsghdr*)buffer; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)){
+                if(nlh->nlmsg_type == NLMSG_DONE){
+                    done = true;
+                    break;
+                }
+                if(nlh->nlmsg_type == NLMSG_ERROR){
+                    loge("arp - netlink dump returned error: %d", ((struct nlmsgerr*)NLMSG_DATA(nlh))->error);
+                    done = true;
+                    rval = false;
+                    break;
+                }
+                if(nlh->nlmsg_type != RTM_NEWNEIGH)
+                    continue;
+
+                struct ndmsg* ndm = (struct ndmsg*)NLMSG_DATA(nlh);
+                if(ndm->ndm_family != AF_INET || !(ndm->ndm_state & nud_mask))
+                    continue;
+                if(ifindex != 0 && static_cast<unsigned int>(ndm->ndm_ifindex) != ifindex)
+                    continue;
+
+                const unsigned char* ip = nullptr;
+                const unsigned char* mac = nullptr;
+                int attr_len = NDA_PAYLOAD(nlh);
+                for(struct rtattr* attr = NDA_RTA(ndm); RTA_OK(attr, attr_len); attr = RTA_NEXT(attr, attr_len)){
+                    if(attr->rta_type == NDA_DST && RTA_PAYLOAD(attr) == 4)
+                        ip = (const unsigned char*)RTA_DATA(attr);
+                    else if(attr->rta_type == NDA_LLADDR && RTA_PAYLOAD(attr) == 6)
+                        mac = (const unsigned char*)RTA_DATA(attr);
+                }
+                if(!ip || !mac)
+                    continue;
+
+                inet_ntop(AF_INET, ip, entry.ip, sizeof(entry.ip));
+                snprintf(entry.mac, sizeof(entry.mac), "%02x:%02x:%02x:%02x:%02x:%02x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+                // logd("Valid mac: %s ip: %s", entry.mac, entry.ip);
+                cmdout.push_back(entry);
             }
         }
 
-        return true;
+        close(sock);
+        logi("arp - neighbor entries found: %ld", cmdout.size());
+        return rval;
     }
 
-    static bool getPmi(const char *ip, char* cmdout){
-        logi("Enter getPmi ip: %s", ip);
-        errno = 0;
-        char cmd[256];
-        FILE *pipe;
-        char buffer[256];
+    // mac of a single ip from kernel neighbor table, false if ip has no resolved entry
+    static bool neighborMac(const char* ip, char* mac, const char* interface=nullptr){
+        logi("Enter neighborMac ip: %s", ip);
+        std::vector<ArpOut> neighbors;
+        if(!arp(neighbors, interface))
+            return false;
+        for(const ArpOut& neighbor : neighbors){
+            if(!strcmp(neighbor.ip, ip)){
+                strcpy(mac, neighbor.mac);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // single quoted for remote /bin/sh, embedded quotes closed and escaped
+    static std::string shellQuote(const std::string& value){
+        std::string quoted = "'";
+        for(char c : value){
+            if(c == '\'')
+                quoted += "'\\''";
+            else
+                quoted += c;
+        }
+        return quoted + "'";
+    }
+
+    // non-interactive ssh argv up to and including the destination, caller appends the remote command
+    static std::vector<std::string> sshArgs(const char* ip, bool keep_master = false){
+        std::vector<std::string> args = {"ssh", "-o", "UserKnownHostsFile=/dev/null", "-o", "StrictHostKeyChecking=no", "-o", "ConnectTimeout=2"};
+        std::vector<std::string> control = controlOptions(keep_master);
+        args.insert(args.end(), control.begin(), control.end());
+        args.insert(args.end(), {"-p", std::to_string(m_port), std::string("root@") + ip});
+        return args;
+    }
+
+    // deadline_s bounds the whole ssh call (connect + auth + command), 0 means no deadline
+    // keep_master leaves an ssh master behind for the session that is about to follow
+    // pmi of device into cmdout of cmdout_size bytes, truncated if longer. Called from worker threads at once
+    static bool getPmi(const char *ip, char* cmdout, size_t cmdout_size, int deadline_s = 5, bool keep_master = false){
+        logi("Enter getPmi ip: %s, deadline: %d, keep_master: %d", ip, deadline_s, keep_master);
+        std::string output;
         char *token = nullptr;
+        char *saveptr = nullptr;
         const char delimiter[] = ":_";
-        int status, exitcode;
-
-        // sprintf(cmd, "ssh -o \"UserKnownHostsFile=/dev/null\" -o \"StrictHostKeyChecking=no\" -o \"ConnectTimeout=3\" -p 10022 -t root@%s \"head -n1 /version.txt\"", ip);
-        sprintf(cmd, "ssh -o \"UserKnownHostsFile=/dev/null\" -o \"StrictHostKeyChecking=no\" -o \"ConnectTimeout=2\" -p %d -qt root@%s \"head -n1 /version.txt\"", m_port, ip);
-        logd("Executing command: %s", cmd);
-        pipe = popen(cmd, "r");
-        
-        fgets(buffer, sizeof(buffer), pipe);
-        // parse pmi
-        strtok(buffer, delimiter);
-        token = strtok(NULL, delimiter);
+        int exitcode;
+
+        std::vector<std::string> args = sshArgs(ip, keep_master);
+        args.insert(args.end() - 1, "-nqt");
+        args.push_back("head -n1 /version.txt");
+        logd("Executing ssh to %s for pmi", ip);
+        exitcode = ProcessRunner::getInstance().run(args, deadline_s*1000, output, 255);
+        if(exitcode == -1){
+            loge("spawn failed for ssh to ip: %s", ip);
+            return false;
+        }
+
+        // parse pmi from first line
+        char buffer[256] = {'\0'};
+        strncpy(buffer, output.c_str(), sizeof(buffer) - 1);
+        buffer[strcspn(buffer, "\n")] = '\0';
+        strtok_r(buffer, delimiter, &saveptr);
+        token = strtok_r(NULL, delimiter, &saveptr);
         if(token){
-            strcpy(cmdout, token);
+            snprintf(cmdout, cmdout_size, "%s", token);
             logd("Pmi is %s for ip: %s", token, ip);
         }
         else{
             loge("Pmi extraction failed for ip: %s", ip);
         }
-        status = pclose(pipe);
-        if((exitcode = WEXITSTATUS(status)) != 0){
-            loge("ssh cmd to extract device pmi failed with exit code: %d", exitcode);
+        if(exitcode != 0){
+            if(exitcode == 124)
+                loge("ssh cmd to extract device pmi hit deadline of %d s for ip: %s", deadline_s, ip);
+            else
+                loge("ssh cmd to extract device pmi failed with exit code: %d", exitcode);
             return false;
         }
         return true;
@@ -164,15 +735,28 @@ class System {
         if(!get_my_ip(my_ip))
             return false;
 
-        system("clear");
-        
-        execlp("ssh", "ssh", "-p", std::to_string(m_port).c_str(), "-o", "UserKnownHostsFile=/dev/null", "-o", "StrictHostKeyChecking=no", "-o", (std::string("BindAddress=")+my_ip).c_str(), (std::string("root@")+target_ip).c_str(), nullptr);
+        // clear screen and scrollback like clear(1), without forking a shell for it
+        if(isatty(STDOUT_FILENO))
+            fputs("\033[H\033[2J\033[3J", stdout);
+        fflush(stdout);
+
+        // reuses master left by reachability check, so session starts without a new handshake
+        std::vector<std::string> args = {"ssh", "-p", std::to_string(m_port), "-o", "UserKnownHostsFile=/dev/null", "-o", "StrictHostKeyChecking=no", "-o", std::string("BindAddress=")+my_ip};
+        std::vector<std::string> control = controlOptions();
+        args.insert(args.end(), control.begin(), control.end());
+        args.push_back(std::string("root@")+target_ip);
+        std::vector<char*> argv;
+        for(std::string& arg : args)
+            argv.push_back(&arg[0]);
+        argv.push_back(nullptr);
+        execvp("ssh", argv.data());
 
         // This region will execute only when exec call fails
-        loge("execSsh - execlp failed errno: %d", errno);
+        loge("execSsh - execvp failed errno: %d", errno);
         return false;
     }
 };
 
 int System::m_port = 10022;
+int System::m_control_persist_s = 300;
 #endif
\ No newline at end of file
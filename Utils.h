@@ -2,6 +2,7 @@
 #define __UTILS_H__
 
 #include <ctime>
+#include <string>
 #include <cstdio>
 #include <sys/time.h>
 #include <cstring>
@@ -9,6 +10,15 @@
 #include <map>
 #include <algorithm>
 #include <cstring>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 class TimeUtil { // Logger class functionality cannot be used inside TimeUtil instead use cout/printf
     private: 
@@ -69,10 +79,75 @@ class TimeUtil { // Logger class functionality cannot be used inside TimeUtil in
 
         return timestamp;
     }
+
+    static std::string toUTC(time_t epoch){ // Formating - YYYY-MM-DDTHH:MM:SS, thread safe
+        char buffer[40];
+        struct tm utc;
+        gmtime_r(&epoch, &utc);
+        snprintf(buffer, sizeof(buffer), "%04d-%02d-%02dT%02d:%02d:%02d",
+            utc.tm_year + 1900, utc.tm_mon + 1, utc.tm_mday, utc.tm_hour, utc.tm_min, utc.tm_sec);
+        return buffer;
+    }
+
+    static time_t fromUTC(const char* utc){ // inverse of toUTC, 0 if not YYYY-MM-DDTHH:MM:SS
+        struct tm parsed = {};
+        if(sscanf(utc, "%4d-%2d-%2dT%2d:%2d:%2d", &parsed.tm_year, &parsed.tm_mon, &parsed.tm_mday, &parsed.tm_hour, &parsed.tm_min, &parsed.tm_sec) != 6)
+            return 0;
+        parsed.tm_year -= 1900;
+        parsed.tm_mon -= 1;
+        return timegm(&parsed);
+    }
+
+    static uint64_t monotonicUs(void){ // steady clock used for deadlines, not affected by wall clock changes
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec)*1000000 + ts.tv_nsec/1000;
+    }
 };
 
 #include "Logger.h" // Logger will expect TimeUtil to be declared
 
+class AddrUtil { // device tables keep ipv4 as uint32 (network byte order) and mac as 6 bytes, text only for display, ssh and csv
+    public:
+    AddrUtil() = delete;
+
+    static uint32_t parseIp(const char* ip){ // 0 if not a dotted ipv4
+        struct in_addr addr;
+        return (inet_pton(AF_INET, ip, &addr) == 1) ? addr.s_addr : 0;
+    }
+
+    static std::string ipToString(uint32_t ip){
+        char buffer[INET_ADDRSTRLEN];
+        struct in_addr addr;
+        addr.s_addr = ip;
+        inet_ntop(AF_INET, &addr, buffer, sizeof(buffer));
+        return buffer;
+    }
+
+    static bool parseMac(const char* mac, uint8_t* out){ // all zero (unknown) if not aa:bb:cc:dd:ee:ff
+        unsigned int bytes[6];
+        memset(out, 0, 6);
+        if(sscanf(mac, "%2x:%2x:%2x:%2x:%2x:%2x", &bytes[0], &bytes[1], &bytes[2], &bytes[3], &bytes[4], &bytes[5]) != 6)
+            return false;
+        for(int i = 0; i < 6; i++)
+            out[i] = static_cast<uint8_t>(bytes[i]);
+        return true;
+    }
+
+    static std::string macToString(const uint8_t* mac){ // empty for unknown mac
+        if(!isKnownMac(mac))
+            return "";
+        char buffer[18];
+        snprintf(buffer, sizeof(buffer), "%02x:%02x:%02x:%02x:%02x:%02x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+        return buffer;
+    }
+
+    static bool isKnownMac(const uint8_t* mac){
+        static const uint8_t unknown[6] = {0};
+        return memcmp(mac, unknown, 6) != 0;
+    }
+};
+
 class ProgressBar {
     private:
     std::string m_description;
@@ -124,10 +199,539 @@ class ProgressBar {
     }
 };
 
+// progress of two overlapping stages eg. network scan and pmi fetch of hosts found so far, safe from worker threads
+class PipelineProgressBar {
+    private:
+    std::string m_description;
+    std::string m_first_name;
+    std::string m_second_name;
+    int m_first_total;
+    int m_first_done;
+    int m_second_total;
+    int m_second_done;
+    int m_bar_width;
+    std::mutex m_mutex;
+
+    void bar(int done, int total){
+        int filled = (total > 0) ? (done*m_bar_width)/total : 0;
+        std::cerr << "[";
+        for(int i = 0; i < m_bar_width; i++)
+            std::cerr << ((i < filled) ? "=" : " ");
+        std::cerr << "]";
+    }
+
+    void display(void){
+        std::cerr << "\r " << m_first_name << " ";
+        bar(m_first_done, m_first_total);
+        std::cerr << " " << ((m_first_total > 0) ? (m_first_done*100)/m_first_total : 100) << "%  ";
+        std::cerr << m_second_name << " ";
+        bar(m_second_done, m_second_total);
+        std::cerr << " " << m_second_done << "/" << m_second_total << "   ";
+    }
+
+    public:
+    PipelineProgressBar(std::string des, std::string first_name, std::string second_name, int width = 25)
+        : m_description(des), m_first_name(first_name), m_second_name(second_name)
+        , m_first_total(0), m_first_done(0), m_second_total(0), m_second_done(0), m_bar_width(width)
+    { }
+
+    void start(int first_total){
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_first_total = first_total;
+        std::cerr << m_description << std::endl;
+        display();
+    }
+
+    void firstStep(void){
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_first_done = std::min(m_first_done + 1, m_first_total);
+        display();
+    }
+
+    void firstComplete(void){
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_first_done = m_first_total;
+        display();
+    }
+
+    // item handed over from first stage to second
+    void secondAdd(void){
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_second_total++;
+        display();
+    }
+
+    void secondStep(void){
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_second_done++;
+        display();
+    }
+
+    void end(void){
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::cerr << std::endl;
+    }
+};
+
+// fixed number of threads running submitted jobs, used to bound concurrent probes
+class WorkerPool {
+    private:
+    std::vector<std::thread> m_workers;
+    std::deque<std::function<void()>> m_jobs;
+    std::mutex m_mutex;
+    std::condition_variable m_job_cv;
+    std::condition_variable m_idle_cv;
+    size_t m_busy;
+    bool m_stop;
+
+    void run(void){
+        while(true){
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_job_cv.wait(lock, [this]{ return m_stop || !m_jobs.empty(); });
+                if(m_jobs.empty())
+                    return;
+                job = std::move(m_jobs.front());
+                m_jobs.pop_front();
+                m_busy++;
+            }
+            job();
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_busy--;
+                if(m_jobs.empty() && m_busy == 0)
+                    m_idle_cv.notify_all();
+            }
+        }
+    }
+
+    public:
+    WorkerPool(size_t worker_count)
+        : m_busy(0), m_stop(false)
+    {
+        if(worker_count == 0)
+            worker_count = 1;
+        for(size_t i = 0; i < worker_count; i++)
+            m_workers.emplace_back(&WorkerPool::run, this);
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    ~WorkerPool(){
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_job_cv.notify_all();
+        for(std::thread& worker : m_workers)
+            worker.join();
+    }
+
+    void submit(std::function<void()> job){
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_jobs.push_back(std::move(job));
+        }
+        m_job_cv.notify_one();
+    }
+
+    // blocks till all submitted jobs are finished
+    void wait(void){
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_idle_cv.wait(lock, [this]{ return m_jobs.empty() && m_busy == 0; });
+    }
+};
+
+// One tar archive written by many device streams at once, see TarStream
+class TarArchive {
+    private:
+    FILE* m_file;
+    std::string m_path;
+    std::mutex m_mutex; // held by a TarStream for the whole of one member
+    friend class TarStream;
+
+    public:
+    TarArchive()
+        : m_file(nullptr)
+    { }
+
+    TarArchive(const TarArchive&) = delete;
+    TarArchive& operator=(const TarArchive&) = delete;
+
+    ~TarArchive(){
+        close();
+    }
+
+    bool open(const std::string& path){
+        m_path = path;
+        m_file = std::fopen(path.c_str(), "wbe"); // close on exec, spawned ssh must not hold it
+        return m_file != nullptr;
+    }
+
+    // end of archive marker, two zero blocks
+    bool close(void){
+        if(!m_file)
+            return true;
+        char zeros[1024] = {'\0'};
+        bool written = std::fwrite(zeros, 1, sizeof(zeros), m_file) == sizeof(zeros);
+        written = (std::fclose(m_file) == 0) && written;
+        m_file = nullptr;
+        return written;
+    }
+};
+
+// Re-packs one incoming tar stream (eg. remote "tar -cf -" over ssh) into a shared TarArchive as data arrives,
+// every member name gets "<dir>/" in front. The archive lock is taken at a member header and released when its
+// last data block is written, so members of concurrent streams never interleave. A stream that finds the lock
+// taken spools its members instead (memory up to SPOOL_MEMORY, then an unlinked file beside the archive) and
+// writes them out once the lock is free, so one stalled device does not hold up reading of the others.
+// Reads gnu, ustar and pax streams. Names and hard link targets of gnu long names ('L'), long links ('K') and pax
+// path/linkpath records are re-prefixed and written back as gnu long names/links, other pax records pass through.
+// Pax global headers ('g') are dropped, they would apply to members of every stream
+class TarStream {
+    private:
+    static constexpr size_t BLOCK = 512;
+    static constexpr size_t SPOOL_MEMORY = 1 << 20;
+
+    TarArchive& m_archive;
+    std::string m_dir;
+    char m_header[BLOCK];
+    size_t m_header_len;
+    uint64_t m_remaining;     // data + padding of current member not yet passed on
+    char m_collecting;        // type of extension header whose data is kept for next member ('L', 'K', 'x', 'g'), else 0
+    std::string m_long_name;
+    std::string m_long_link;
+    std::string m_pax;
+    char m_pax_header[BLOCK];
+    std::unique_lock<std::mutex> m_lock;
+    bool m_spooling;          // members go to m_spool/m_spool_file until archive lock is free
+    std::string m_spool;
+    FILE* m_spool_file;
+    size_t m_members;
+    uint64_t m_bytes;
+    bool m_write_failed;
+
+    static uint64_t parseNumber(const char* field, size_t len){
+        if(static_cast<unsigned char>(field[0]) & 0x80){ // base-256, files over 8G
+            uint64_t value = 0;
+            for(size_t i = 1; i < len; i++)
+                value = (value << 8) | static_cast<unsigned char>(field[i]);
+            return value;
+        }
+        uint64_t value = 0;
+        for(size_t i = 0; i < len && field[i] >= '0' && field[i] <= '7'; i++)
+            value = (value << 3) | (field[i] - '0');
+        return value;
+    }
+
+    static void setChecksum(char* header){
+        unsigned int sum = 0;
+        std::memset(header + 148, ' ', 8);
+        for(size_t i = 0; i < BLOCK; i++)
+            sum += static_cast<unsigned char>(header[i]);
+        snprintf(header + 148, 7, "%06o", sum);
+        header[154] = '\0';
+        header[155] = ' ';
+    }
+
+    static bool isPosixUstar(const char* header){
+        return std::memcmp(header + 257, "ustar\0", 6) == 0;
+    }
+
+    // octal while it fits 11 digits, else base-256 like gnu tar
+    static void setSize(char* header, uint64_t size){
+        if(size < (1ULL << 33)){
+            char octal[24];
+            snprintf(octal, sizeof(octal), "%011llo", static_cast<unsigned long long>(size));
+            std::memcpy(header + 124, octal, 12);
+            return;
+        }
+        header[124] = static_cast<char>(0x80);
+        for(int i = 11; i > 0; i--, size >>= 8)
+            header[124 + i] = static_cast<char>(size & 0xff);
+    }
+
+    void write(const char* data, size_t len){
+        if(len == 0 || m_write_failed)
+            return;
+        if(std::fwrite(data, 1, len, m_archive.m_file) != len)
+            m_write_failed = true;
+        m_bytes += len;
+    }
+
+    // data of current member, to archive or to its spool
+    void emit(const char* data, size_t len){
+        if(!m_spooling){
+            write(data, len);
+            return;
+        }
+        if(len == 0 || m_write_failed)
+            return;
+        if(!m_spool_file && m_spool.size() + len > SPOOL_MEMORY){
+            std::string path = m_archive.m_path + ".spoolXXXXXX";
+            int fd = mkostemp(&path[0], O_CLOEXEC);
+            if(fd >= 0){
+                unlink(path.c_str());
+                m_spool_file = fdopen(fd, "w+");
+                if(!m_spool_file)
+                    ::close(fd);
+            }
+            if(!m_spool_file || std::fwrite(m_spool.data(), 1, m_spool.size(), m_spool_file) != m_spool.size()){
+                m_write_failed = true;
+                return;
+            }
+            m_spool.clear();
+        }
+        if(m_spool_file){
+            if(std::fwrite(data, 1, len, m_spool_file) != len)
+                m_write_failed = true;
+        }
+        else
+            m_spool.append(data, len);
+    }
+
+    // archive lock already held, spooled members go in ahead of anything newer of this stream
+    void flushSpool(void){
+        m_spooling = false;
+        write(m_spool.data(), m_spool.size());
+        m_spool.clear();
+        if(m_spool_file){
+            char buffer[16384];
+            size_t len;
+            std::rewind(m_spool_file);
+            while(!m_write_failed && (len = std::fread(buffer, 1, sizeof(buffer), m_spool_file)) > 0)
+                write(buffer, len);
+            if(std::ferror(m_spool_file))
+                m_write_failed = true;
+            std::fclose(m_spool_file);
+            m_spool_file = nullptr;
+        }
+    }
+
+    void beginMember(void){
+        if(!m_archive.m_mutex.try_lock()){
+            m_spooling = true;
+            return;
+        }
+        m_lock = std::unique_lock<std::mutex>(m_archive.m_mutex, std::adopt_lock);
+        flushSpool();
+    }
+
+    // last block of current member was emitted, spooled members go in if archive is free by now
+    void endMember(void){
+        if(m_lock.owns_lock())
+            m_lock.unlock();
+        else if(m_spooling && m_archive.m_mutex.try_lock()){
+            std::lock_guard<std::mutex> lock(m_archive.m_mutex, std::adopt_lock);
+            flushSpool();
+        }
+    }
+
+    void writeLongName(const std::string& name, char type){
+        char header[BLOCK] = {'\0'};
+        strcpy(header, "././@LongLink");
+        strcpy(header + 100, "0000644");
+        strcpy(header + 108, "0000000");
+        strcpy(header + 116, "0000000");
+        setSize(header, name.size() + 1);
+        strcpy(header + 136, "00000000000");
+        header[156] = type;
+        std::memcpy(header + 257, "ustar  ", 8);
+        setChecksum(header);
+        emit(header, BLOCK);
+        std::string data(name);
+        data.resize((name.size() + 1 + BLOCK - 1)/BLOCK*BLOCK, '\0');
+        emit(data.data(), data.size());
+    }
+
+    // takes path and linkpath out of pax records ("<len> <key>=<value>\n"), the rest is kept for the pax header.
+    // A size record (files over 8G) replaces size of the member header
+    void splitPax(std::string& name, std::string& link){
+        std::string kept;
+        size_t pos = 0;
+        while(pos < m_pax.size()){
+            size_t space = m_pax.find(' ', pos);
+            if(space == std::string::npos)
+                break;
+            size_t len = std::strtoul(m_pax.c_str() + pos, nullptr, 10);
+            if(len <= space - pos || pos + len > m_pax.size())
+                break; // corrupt record, rest is dropped
+            std::string record = m_pax.substr(space + 1, pos + len - space - 2); // without trailing newline
+            size_t equal = record.find('=');
+            std::string key = record.substr(0, equal);
+            if(key == "path" && equal != std::string::npos)
+                name = record.substr(equal + 1);
+            else if(key == "linkpath" && equal != std::string::npos)
+                link = record.substr(equal + 1);
+            else{
+                if(key == "size" && equal != std::string::npos)
+                    m_remaining = (std::strtoull(record.c_str() + equal + 1, nullptr, 10) + BLOCK - 1)/BLOCK*BLOCK;
+                kept.append(m_pax, pos, len);
+            }
+            pos += len;
+        }
+        m_pax = kept;
+    }
+
+    void handleHeader(void){
+        bool zero = true;
+        for(size_t i = 0; i < BLOCK && zero; i++)
+            zero = (m_header[i] == '\0');
+        if(zero) // end of stream marker, archive gets a single one on close
+            return;
+
+        uint64_t size = parseNumber(m_header + 124, 12);
+        m_remaining = (size + BLOCK - 1)/BLOCK*BLOCK;
+        char type = m_header[156];
+        if(type == 'L' || type == 'K' || type == 'x' || type == 'g'){
+            m_collecting = (m_remaining > 0) ? type : 0;
+            if(type == 'L')
+                m_long_name.clear();
+            else if(type == 'K')
+                m_long_link.clear();
+            else if(type == 'x'){
+                m_pax.clear();
+                std::memcpy(m_pax_header, m_header, BLOCK);
+            }
+            return;
+        }
+
+        std::string name;
+        if(!m_long_name.empty()){
+            name = m_long_name.c_str(); // up to nul, padding dropped
+            m_long_name.clear();
+        }
+        else{
+            name.assign(m_header, strnlen(m_header, 100));
+            if(isPosixUstar(m_header) && m_header[345] != '\0')
+                name = std::string(m_header + 345, strnlen(m_header + 345, 155)) + "/" + name;
+        }
+        std::string link;
+        if(!m_long_link.empty()){
+            link = m_long_link.c_str();
+            m_long_link.clear();
+        }
+        else
+            link.assign(m_header + 157, strnlen(m_header + 157, 100));
+        splitPax(name, link);
+        std::string path = m_dir + "/" + name;
+        // hard link target is a member of the same stream, it moved under m_dir too
+        if(type == '1')
+            link = m_dir + "/" + link;
+
+        beginMember();
+        if(path.size() > 100)
+            writeLongName(path, 'L');
+        if(link.size() > 100)
+            writeLongName(link, 'K');
+        if(!m_pax.empty()){
+            setSize(m_pax_header, m_pax.size());
+            setChecksum(m_pax_header);
+            emit(m_pax_header, BLOCK);
+            m_pax.resize((m_pax.size() + BLOCK - 1)/BLOCK*BLOCK, '\0');
+            emit(m_pax.data(), m_pax.size());
+            m_pax.clear();
+        }
+
+        std::memset(m_header, '\0', 100);
+        std::memcpy(m_header, path.c_str(), std::min<size_t>(path.size(), 100));
+        if(isPosixUstar(m_header))
+            std::memset(m_header + 345, '\0', 155);
+        std::memset(m_header + 157, '\0', 100);
+        std::memcpy(m_header + 157, link.c_str(), std::min<size_t>(link.size(), 100));
+        setChecksum(m_header);
+        emit(m_header, BLOCK);
+        m_members++;
+        if(m_remaining == 0)
+            endMember();
+    }
+
+    public:
+    TarStream(TarArchive& archive, const std::string& dir)
+        : m_archive(archive), m_dir(dir), m_header_len(0), m_remaining(0), m_collecting(0)
+        , m_spooling(false), m_spool_file(nullptr), m_members(0), m_bytes(0), m_write_failed(false)
+    { }
+
+    ~TarStream(){
+        finish();
+    }
+
+    void feed(const char* data, size_t len){
+        while(len > 0){
+            if(m_remaining > 0){
+                size_t chunk = static_cast<size_t>(std::min<uint64_t>(len, m_remaining));
+                if(m_collecting == 'L')
+                    m_long_name.append(data, chunk);
+                else if(m_collecting == 'K')
+                    m_long_link.append(data, chunk);
+                else if(m_collecting == 'x')
+                    m_pax.append(data, chunk);
+                else if(m_collecting == 0) // data of a 'g' header is dropped
+                    emit(data, chunk);
+                m_remaining -= chunk;
+                data += chunk;
+                len -= chunk;
+                if(m_remaining == 0){
+                    if(m_collecting == 0)
+                        endMember();
+                    m_collecting = 0;
+                }
+                continue;
+            }
+
+            size_t chunk = std::min(len, BLOCK - m_header_len);
+            std::memcpy(m_header + m_header_len, data, chunk);
+            m_header_len += chunk;
+            data += chunk;
+            len -= chunk;
+            if(m_header_len == BLOCK){
+                m_header_len = 0;
+                handleHeader();
+            }
+        }
+    }
+
+    // false when stream stopped inside a member, that member is zero padded so the archive stays readable
+    bool finish(void){
+        bool complete = (m_remaining == 0 && m_header_len == 0);
+        if(m_collecting == 0 && m_remaining > 0){ // inside data of a member
+            char zeros[BLOCK] = {'\0'};
+            while(m_remaining > 0){
+                size_t chunk = static_cast<size_t>(std::min<uint64_t>(BLOCK, m_remaining));
+                emit(zeros, chunk);
+                m_remaining -= chunk;
+            }
+            endMember();
+        }
+        if(m_spooling){ // waits only for a member in progress of another stream
+            std::lock_guard<std::mutex> lock(m_archive.m_mutex);
+            flushSpool();
+        }
+        m_remaining = 0;
+        m_header_len = 0;
+        m_collecting = 0;
+        m_long_name.clear();
+        m_long_link.clear();
+        m_pax.clear();
+        return complete && !m_write_failed;
+    }
+
+    inline size_t members(void){
+        return m_members;
+    }
+
+    inline uint64_t bytes(void){
+        return m_bytes;
+    }
+};
+
 class ArgParser {
     private:
     bool m_valid;
     std::string m_options;
+    std::string m_raw_options; // values kept as typed, eg. remote command of -x
     std::map<char, std::string> m_console_option;
 
     void toLower(std::string &s){
@@ -148,7 +752,8 @@ class ArgParser {
             // odd index arg should start with '-'
             if(arg[i][0] == '-' && m_options.find(arg[i][1]) != std::string::npos){
                 value = arg[i+1];
-                toLower(value);
+                if(m_raw_options.find(arg[i][1]) == std::string::npos)
+                    toLower(value);
                 m_console_option.insert(std::make_pair(arg[i][1], value));
                 logd("parsing console args - make_pair(arg[i][1]: %c, arg[i+1]: %s)", arg[i][1], value.c_str());
                 value.clear();
@@ -166,7 +771,8 @@ class ArgParser {
     ArgParser() = delete;
     ArgParser(int argc, char* argv[])
         : m_valid(false)
-        , m_options("ndctoiv")
+        , m_options("ndctoivrmjkaxfl")
+        , m_raw_options("xfl")
     {
         // always count should be a odd value
         if(argc % 2 != 0)
@@ -206,6 +812,21 @@ class ArgParser {
         fprintf(stderr, " To geracefully close SSH connection:\n");
         fprintf(stderr, " \tcssh -c <ntid>\n");
 
+        fprintf(stderr, " To pick best free device without prompts: (connect, or reserve and print its ip)\n");
+        fprintf(stderr, " \tcssh -n <ntid> -d <device model name> -a [connect/ip]\n");
+
+        fprintf(stderr, " To close connection of a device without prompts:\n");
+        fprintf(stderr, " \tcssh -c <ntid> -i <ip>\n");
+
+        fprintf(stderr, " To run a command on all devices of a model: (-o collect groups output per device, -j parallel sessions, default 32)\n");
+        fprintf(stderr, " \tcssh -t exec -d <device model name> -x \"<command>\" [-o collect] [-j <count>]\n");
+
+        fprintf(stderr, " To copy a file to all devices of a model: (-l remote path, default /tmp/<file name>, -o chain relays device to device)\n");
+        fprintf(stderr, " \tcssh -t push -d <device model name> -f <file> [-l <remote path>] [-o chain] [-j <count>]\n");
+
+        fprintf(stderr, " To collect files and/or command output of all devices of a model into one tar: (-l local archive)\n");
+        fprintf(stderr, " \tcssh -t collect -d <device model name> -f \"<remote paths>\" [-x \"<command>\"] [-l <archive>] [-j <count>]\n");
+
         fprintf(stderr, " To list user specific device info: \n");
         fprintf(stderr, " \tcssh -t list -n <ntid>\n");
 
@@ -218,6 +839,21 @@ class ArgParser {
         fprintf(stderr, " To scan network and update device cache: \n");
         fprintf(stderr, " \tcssh -t scan\n");
 
+        fprintf(stderr, " To rebuild device cache from scratch: (default scan re-probes only new or changed devices)\n");
+        fprintf(stderr, " \tcssh -t scan -o full\n");
+
+        fprintf(stderr, " To scan specific ranges: (default is 10.0.0.0/24)\n");
+        fprintf(stderr, " \tcssh -t scan -r <cidr/ip range>[,<cidr/ip range>...]\n");
+
+        fprintf(stderr, " To scan with arp requests instead of ping: (finds devices that ignore ping in standby)\n");
+        fprintf(stderr, " \tcssh -t scan -m arp\n");
+
+        fprintf(stderr, " To set number of devices probed in parallel for pmi: (default is 8)\n");
+        fprintf(stderr, " \tcssh -t scan -j <count>\n");
+
+        fprintf(stderr, " To stop looking for a missing model after these many devices: (default is 3)\n");
+        fprintf(stderr, " \tcssh -n <ntid> -d <device model name> -k <count>\n");
+
         fprintf(stderr, " To change ip addr of any device in cache: ( default port is 10022)\n");
         fprintf(stderr, " \tcssh -t mod -o cache\n");
 
@@ -231,7 +867,7 @@ class ArgParser {
         fprintf(stderr, " \tcat ~/cssh/device_login_record.csv\n");
 
         fprintf(stderr, "\n *commads are case-insensitive\n");
-        fprintf(stderr, "\n | 'n'tid, 'd'evice, 'c'lose, 't'ype, 'o'utput, 'i'p  'p'ort |\n");
+        fprintf(stderr, "\n | 'n'tid, 'd'evice, 'c'lose, 't'ype, 'o'utput, 'i'p  'p'ort, 'r'ange, 'm'ode, 'j'obs, 'k' matches |\n");
 
         fprintf(stderr, " %s\n", hypens);
     }
@@ -1,8 +1,39 @@
 #include <cstring>
+#include <cstdlib>
 #include "Utils.h"
 #include "Logger.h"
 #include "Cssh.h"
 
+static bool applyScanOptions(ArgParser& console_opt, Cssh& _cssh){
+    if(console_opt.hasOption('r'))
+        _cssh.setScanRange(console_opt.getOption('r'));
+    if(console_opt.hasOption('m')){
+        std::string mode = console_opt.getOption('m');
+        logi("ConsoleArgs -m: %s", mode.c_str());
+        if(mode == "arp")
+            _cssh.setScanMode(Device::ScanMode::ARP);
+        else if(mode == "icmp")
+            _cssh.setScanMode(Device::ScanMode::ICMP);
+        else
+            return false;
+    }
+    if(console_opt.hasOption('j')){
+        int workers = std::atoi(console_opt.getOption('j').c_str());
+        logi("ConsoleArgs -j: %d", workers);
+        if(workers <= 0)
+            return false;
+        _cssh.setPmiWorkers(workers);
+    }
+    if(console_opt.hasOption('k')){
+        int matches = std::atoi(console_opt.getOption('k').c_str());
+        logi("ConsoleArgs -k: %d", matches);
+        if(matches <= 0)
+            return false;
+        _cssh.setModelMatches(matches);
+    }
+    return true;
+}
+
 // NOTE: All message that intended to be visible to user are cooded with fprintf(stderr)
 
 int main(int argc, char* argv[]){
@@ -33,12 +64,27 @@ int main(int argc, char* argv[]){
             std::string model =  console_opt.getOption('d');
             logi("ConsoleArgs -n: %s; -d: %s",ntid.c_str(), model.c_str());
             Cssh _cssh(ntid, model);
+            if(!applyScanOptions(console_opt, _cssh)){
+                console_opt.displayHelp();
+                return Cssh::AUTO_USAGE;
+            }
+            if(console_opt.hasOption('a')){
+                std::string auto_mode = console_opt.getOption('a');
+                logi("ConsoleArgs -a: %s", auto_mode.c_str());
+                if(auto_mode != "connect" && auto_mode != "ip"){
+                    console_opt.displayHelp();
+                    return Cssh::AUTO_USAGE;
+                }
+                return _cssh.autoConnect(auto_mode == "ip");
+            }
             _cssh.connect();
         }
         else if(console_opt.hasOption('c')){
         std::string ntid =  console_opt.getOption('c');
         logi("ConsoleArgs -c: %s",ntid.c_str());
         Cssh _cssh(ntid);
+        if(console_opt.hasOption('i'))
+            return _cssh.close(console_opt.getOption('i'));
         _cssh.close();
         }
         else if(console_opt.hasOption('t')){
@@ -67,11 +113,67 @@ int main(int argc, char* argv[]){
             }
             else if(type_value == "scan"){
                 Cssh _cssh;
-                if(!_cssh.createDeviceCache()){
+                if(console_opt.hasOption('o') && console_opt.getOption('o') == "full")
+                    _cssh.setIncrementalScan(false);
+                if(!applyScanOptions(console_opt, _cssh))
+                    console_opt.displayHelp();
+                else if(!_cssh.createDeviceCache()){
                     fprintf(stderr, " Some issue with creating device cache, exiting...\n");
                 }
                 _cssh.cleanUp();
             }
+            else if(type_value == "exec"){
+                if(!console_opt.hasOption('d') || !console_opt.hasOption('x')){
+                    console_opt.displayHelp();
+                    return Cssh::AUTO_USAGE;
+                }
+                std::string ntid;
+                std::string model = console_opt.getOption('d');
+                std::string command = console_opt.getOption('x');
+                int workers = console_opt.hasOption('j') ? std::atoi(console_opt.getOption('j').c_str()) : 32;
+                bool collect = console_opt.hasOption('o') && console_opt.getOption('o') == "collect";
+                logi("ConsoleArgs -d: %s; -x: %s; -j: %d", model.c_str(), command.c_str(), workers);
+                if(workers <= 0){
+                    console_opt.displayHelp();
+                    return Cssh::AUTO_USAGE;
+                }
+                Cssh _cssh(ntid, model);
+                return _cssh.execAll(command, collect, workers);
+            }
+            else if(type_value == "push"){
+                if(!console_opt.hasOption('d') || !console_opt.hasOption('f')){
+                    console_opt.displayHelp();
+                    return Cssh::AUTO_USAGE;
+                }
+                std::string ntid;
+                std::string model = console_opt.getOption('d');
+                bool chain = console_opt.hasOption('o') && console_opt.getOption('o') == "chain";
+                // shared wlan is the bottleneck, a few uploads saturate it, one chain sends every byte once
+                int workers = console_opt.hasOption('j') ? std::atoi(console_opt.getOption('j').c_str()) : (chain ? 1 : 4);
+                logi("ConsoleArgs -d: %s; -f: %s; -l: %s; -j: %d", model.c_str(), console_opt.getOption('f').c_str(), console_opt.getOption('l').c_str(), workers);
+                if(workers <= 0){
+                    console_opt.displayHelp();
+                    return Cssh::AUTO_USAGE;
+                }
+                Cssh _cssh(ntid, model);
+                return _cssh.pushAll(console_opt.getOption('f'), console_opt.getOption('l'), chain, workers);
+            }
+            else if(type_value == "collect"){
+                if(!console_opt.hasOption('d') || (!console_opt.hasOption('f') && !console_opt.hasOption('x'))){
+                    console_opt.displayHelp();
+                    return Cssh::AUTO_USAGE;
+                }
+                std::string ntid;
+                std::string model = console_opt.getOption('d');
+                int workers = console_opt.hasOption('j') ? std::atoi(console_opt.getOption('j').c_str()) : 8;
+                logi("ConsoleArgs -d: %s; -f: %s; -x: %s; -l: %s; -j: %d", model.c_str(), console_opt.getOption('f').c_str(), console_opt.getOption('x').c_str(), console_opt.getOption('l').c_str(), workers);
+                if(workers <= 0){
+                    console_opt.displayHelp();
+                    return Cssh::AUTO_USAGE;
+                }
+                Cssh _cssh(ntid, model);
+                return _cssh.collectAll(console_opt.getOption('f'), console_opt.getOption('x'), console_opt.getOption('l'), workers);
+            }
             else if(type_value == "mod"){
                 if(console_opt.hasOption('o')){
                     if(console_opt.getOption('o') == "cache"){